@@ -0,0 +1,399 @@
+// Operating Systems Project 5
+// Description: What a worker does, kept apart from how it waits so the same logic can run as its own process (worker.cpp) or as one of
+// thousands of tasks inside oss (tasks.h). A Client holds one worker's state. clientStep moves it on as far as it can go without
+// waiting, then says what it is waiting for: a reply from oss, the clock reaching a time, or nothing since it has decided to exit.
+// Replies are handed to it with clientReply. A worker process blocks on whatever it is waiting for, while oss's task threads move on to
+// other clients and come back to it.
+// Within a lifetime, a client randomly picks a time to act within BOUND_NS. When it acts, it randomly decides to request resources or
+// release one it holds and sends oss a message carrying each resource and how many instances. Each message sent and reply received
+// moves the clock 1000 ns. Every TERM_CHECK_NS, once it has lived LIFE_NS, it randomly decides to exit, and oss takes back every
+// resource it held.
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "clock.h"
+#include "transport.h"
+
+#define BOUND_NS 1000
+#define TERM_CHECK_NS 250000000
+#define LIFE_NS 2000000000
+#define TERM_PROB 40
+
+// What a client is waiting for after a step
+#define CLIENT_REPLY 0 // A reply from oss
+#define CLIENT_CLOCK 1 // The clock reaching wakeAt
+#define CLIENT_EXIT 2 // Nothing, it has decided to exit
+
+// Structure for a request or release sent to oss that has not been replied to yet
+typedef struct
+{
+	uint32_t seq; // Number the message was sent with, oss sends it back in the reply
+	bool release; // Release rather than request
+	int nUnits; // Amount of pairs in units
+	ResUnits units[MSG_UNITS]; // Resources and how many of each
+} Op;
+
+// Structure for one worker's state
+typedef struct Client
+{
+	// Set by whoever runs the client, before clientAlloc
+	SimClock* clock; // System clock
+	pid_t pid; // Sent with every message so oss can find the sender's slot. Also seeds the client's random numbers
+	int nRes; // Amount of resource types
+	const int* total; // Instances of each resource
+	int burst; // Most instances to ask for in one request
+	int maxOps; // Most requests and releases in flight at once. With one, the client waits for each reply before going on
+	bool des; // Discrete event mode, the client sleeps by asking oss to reply at a time and only oss moves the clock
+	bool avoid; // oss is avoiding deadlock, so the client must declare its claims before requesting
+	void (*send)(struct Client* c, msgbuffer* msg); // Sends a message to oss
+
+	// Kept by the client
+	unsigned int seed; // State of the client's own random numbers, so clients sharing a thread do not share one sequence
+	unsigned int lives; // Lifetimes started, mixed into the seed so a worker reused for a new lifetime does not repeat the last one
+	int* held; // How many of each resource client holds
+	int* asked; // How many more of each it has requested that are not granted yet
+	int* claim; // Most of each resource client will ever hold. Without avoidance it may take every instance
+	Op* inFlight; // Requests and releases in flight
+	int nInFlight; // Amount of operations in inFlight
+	uint32_t nextSeq; // Number for the next operation sent
+	uint64_t startTimeNs; // Time the lifetime started
+	uint64_t lastTermChk; // Time of the last term check
+	uint64_t nAct; // Time to act next
+	int nextClaim; // First resource whose claim has not been declared yet
+	int awaiting; // MSG_CLAIM or MSG_SLEEP while waiting on the reply to one before doing anything else, -1 otherwise
+	bool awake; // In discrete event mode, oss has replied to the last sleep so the client can act
+	uint64_t wakeAt; // Time the client is waiting for, after a step that returned CLIENT_CLOCK
+} Client;
+
+// Function to allocate a client's tables once its settings are filled in. They are reused by every lifetime the client starts
+inline void clientAlloc(Client* c)
+{
+	c->held = new int[c->nRes];
+	c->asked = new int[c->nRes];
+	c->claim = new int[c->nRes];
+	c->inFlight = new Op[c->maxOps];
+	c->lives = 0;
+}
+
+// Function to free a client's tables
+inline void clientFree(Client* c)
+{
+	delete[] c->held;
+	delete[] c->asked;
+	delete[] c->claim;
+	delete[] c->inFlight;
+}
+
+// Function to increment time by 1000 ns. In discrete event mode only oss moves the clock, so this does nothing
+inline void clientAddTime(Client* c)
+{
+	if (!c->des)
+		clockAdvance(c->clock, 1000);
+}
+
+// Function to start a new lifetime for the client as c->pid, holding and asking for nothing, with claims to declare in avoidance mode
+inline void clientStart(Client* c)
+{
+	c->seed = c->pid + c->lives++ * 1000003;
+	for (int i = 0; i < c->nRes; i++)
+	{
+		c->held[i] = 0;
+		c->asked[i] = 0;
+	}
+	c->nInFlight = 0;
+	c->nextSeq = 1;
+	c->awaiting = -1;
+	c->awake = false;
+
+	// Randomly generate a time within bound ns to determine when client will act
+	c->startTimeNs = clockNow(c->clock);
+	c->lastTermChk = c->startTimeNs;
+	c->nAct = c->startTimeNs + rand_r(&c->seed) % BOUND_NS;
+
+	for (int i = 0; i < c->nRes; i++)
+		c->claim[i] = c->avoid ? 1 + rand_r(&c->seed) % c->total[i] : c->total[i];
+	c->nextClaim = c->avoid ? 0 : c->nRes;
+}
+
+// Function to apply oss's reply to a request or release in flight. Replies can arrive in any order, so the operation is found by the
+// sequence number the reply carries. A granted request adds to what the client holds, releases were taken off when sent
+inline void clientComplete(Client* c, const msgbuffer* reply)
+{
+	for (int i = 0; i < c->nInFlight; i++)
+	{
+		Op* op = &c->inFlight[i];
+		if (op->seq != reply->seq)
+			continue;
+		for (int u = 0; !op->release && u < op->nUnits; u++)
+		{
+			c->asked[op->units[u].resId] -= op->units[u].count;
+			if (reply->granted)
+				c->held[op->units[u].resId] += op->units[u].count;
+		}
+		c->inFlight[i] = c->inFlight[--c->nInFlight];
+		return;
+	}
+}
+
+// Function to hand the client a reply from oss, which acknowledges its claim, wakes it from a sleep, or answers an operation in flight
+inline void clientReply(Client* c, const msgbuffer* reply)
+{
+	// Increment time for message receiving
+	clientAddTime(c);
+	if (c->awaiting == MSG_SLEEP)
+		c->awake = true;
+	if (c->awaiting >= 0)
+		c->awaiting = -1;
+	else
+		clientComplete(c, reply);
+}
+
+// Function to randomly pick what the client does when it acts: request instances of up to MSG_UNITS resources under the claim, or
+// release one instance held. Fills in buf, with no pairs if there is nothing to request or release. Only draws random numbers, so
+// picking again from the same seed gives the same message
+inline void clientPick(Client* c, msgbuffer* msg)
+{
+	msgbuffer& buf = *msg;
+	// Randomly generate number up to 100 to determine if client will request or release. Above 5 it requests
+	bool release = rand_r(&c->seed) % 100 <= 5;
+
+	// Prepare info to send message to OSS, informing if it is a release or request and what resources are selected
+	buf.mtype = 1;
+	buf.pid = c->pid;
+	buf.kind = release ? MSG_RELEASE : MSG_REQUEST;
+	buf.nUnits = 0;
+	buf.partial = false;
+	buf.granted = false;
+	buf.wakeAt = 0;
+	if (release) // Client is releasing
+	{
+		// Randomly choose a resource to release
+		int tries = 0;
+		int r = 0;
+		while (tries < c->nRes)
+		{
+			r = rand_r(&c->seed) % c->nRes;
+			if (c->held[r] > 0)
+				break;
+			tries++;
+		}
+		if (tries < c->nRes)
+			buf.units[buf.nUnits++] = {r, 1};
+	}
+	else // Client is requesting
+	{
+		// Randomly choose how many instances to request, then hand them out one at a time to randomly chosen resources with room
+		// left under the claim, using at most MSG_UNITS different resources
+		int want = 1 + rand_r(&c->seed) % c->burst;
+		while (want > 0)
+		{
+			int tries = 0;
+			while (tries < c->nRes)
+			{
+				int r = rand_r(&c->seed) % c->nRes;
+				// Find the pair for r if it is already being requested
+				int u = 0;
+				while (u < buf.nUnits && buf.units[u].resId != r)
+					u++;
+				int more = u < buf.nUnits ? buf.units[u].count : 0;
+				if (c->held[r] + c->asked[r] + more < c->claim[r] && (u < buf.nUnits || buf.nUnits < MSG_UNITS))
+				{
+					if (u == buf.nUnits)
+						buf.units[buf.nUnits++] = {r, 0};
+					buf.units[u].count++;
+					break;
+				}
+				tries++;
+			}
+			if (tries == c->nRes)
+				break;
+			want--;
+		}
+		// Either wait for the whole request at once or take instances as they free up
+		if (buf.nUnits > 0)
+			buf.partial = rand_r(&c->seed) % 2;
+	}
+}
+
+// Function to find if any act could do something, meaning the client holds an instance to release or has room under its claim to ask
+// for more
+inline bool clientCanAct(const Client* c)
+{
+	for (int i = 0; i < c->nRes; i++)
+		if (c->held[i] > 0 || c->held[i] + c->asked[i] < c->claim[i])
+			return true;
+	return false;
+}
+
+// Function to move the next act past every act that would do nothing, for discrete event mode, where each sleep is a round trip with
+// oss. Each act is picked the same way clientAct picks it, and the seed is put back before the first one that does something so it
+// is picked again when it runs. Stops at the next term check, or with requests in flight, whose replies may let it do more, a term
+// check interval on. If no act could do anything, goes straight there
+inline void clientSkipIdle(Client* c)
+{
+	uint64_t until = c->nInFlight == 0 ? c->lastTermChk + TERM_CHECK_NS : c->nAct + TERM_CHECK_NS;
+	if (!clientCanAct(c))
+	{
+		if (c->nAct < until)
+			c->nAct = until;
+		return;
+	}
+	msgbuffer buf;
+	while (c->nAct < until)
+	{
+		unsigned seed = c->seed;
+		clientPick(c, &buf);
+		if (buf.nUnits > 0)
+		{
+			c->seed = seed;
+			return;
+		}
+		c->nAct += rand_r(&c->seed) % BOUND_NS;
+	}
+}
+
+// Function to find when a client in discrete event mode has something to do next once request or release op, the only one it may have
+// in flight, is done: its next act that does something, or its term check if that comes first. Plans as if a request is granted,
+// putting the tables back after
+inline uint64_t clientPlanAfter(Client* c, const Op* op)
+{
+	for (int u = 0; !op->release && u < op->nUnits; u++)
+	{
+		c->asked[op->units[u].resId] -= op->units[u].count;
+		c->held[op->units[u].resId] += op->units[u].count;
+	}
+	c->nInFlight--;
+	clientSkipIdle(c);
+	uint64_t wakeAt = c->nAct;
+	if (c->nInFlight == 0 && c->lastTermChk + TERM_CHECK_NS < wakeAt)
+		wakeAt = c->lastTermChk + TERM_CHECK_NS;
+	c->nInFlight++;
+	for (int u = 0; !op->release && u < op->nUnits; u++)
+	{
+		c->asked[op->units[u].resId] += op->units[u].count;
+		c->held[op->units[u].resId] -= op->units[u].count;
+	}
+	return wakeAt;
+}
+
+// Function to act at time now: pick a request or release, send it, and keep it until its reply comes, then pick the next time to act.
+// Does nothing but pick that time if there is nothing to request or release
+inline void clientAct(Client* c, uint64_t now)
+{
+	msgbuffer buf;
+	clientPick(c, &buf);
+	bool release = buf.kind == MSG_RELEASE;
+
+	// Randomly generate time for next act
+	c->nAct = now + rand_r(&c->seed) % BOUND_NS;
+
+	// Once max resource amount is reached or nothing is held, only pick the next time to act
+	if (buf.nUnits > 0)
+	{
+		// Number the message and keep it until its reply comes. Released instances are given up right away so they are not
+		// released twice, requested ones are counted against the claim until granted
+		buf.seq = c->nextSeq++;
+		Op* op = &c->inFlight[c->nInFlight++];
+		op->seq = buf.seq;
+		op->release = release;
+		op->nUnits = buf.nUnits;
+		for (int u = 0; u < buf.nUnits; u++)
+		{
+			op->units[u] = buf.units[u];
+			if (release)
+				c->held[buf.units[u].resId] -= buf.units[u].count;
+			else
+				c->asked[buf.units[u].resId] += buf.units[u].count;
+		}
+
+		// In discrete event mode a client with one operation in flight waits for its reply anyway, so it asks oss to hold the reply
+		// until it next has something to do instead of sending a sleep message of its own after
+		if (c->des && c->maxOps == 1)
+			buf.wakeAt = clientPlanAfter(c, op);
+
+		// Send request/release message to OSS, and increment time for message sending
+		c->send(c, &buf);
+		clientAddTime(c);
+	}
+}
+
+// Function to move the client on as far as it can go without waiting. Returns CLIENT_REPLY if it needs a reply from oss first,
+// CLIENT_CLOCK if it needs the clock to reach c->wakeAt, or CLIENT_EXIT once it has decided to exit
+inline int clientStep(Client* c)
+{
+	// Wait for oss to reply to a claim or sleep, or to an operation once no more can be in flight
+	if (c->awaiting >= 0 || c->nInFlight == c->maxOps)
+		return CLIENT_REPLY;
+
+	msgbuffer buf;
+	buf.mtype = 1;
+	buf.pid = c->pid;
+	buf.seq = 0;
+	buf.nUnits = 0;
+
+	// Declare claims to oss, as many resources per message as fit, waiting for each message to be acknowledged
+	if (c->nextClaim < c->nRes)
+	{
+		buf.kind = MSG_CLAIM;
+		for (int j = c->nextClaim; j < c->nRes && j < c->nextClaim + MSG_UNITS; j++)
+			buf.units[buf.nUnits++] = {j, c->claim[j]};
+		c->nextClaim += MSG_UNITS;
+		c->awaiting = MSG_CLAIM;
+		c->send(c, &buf);
+		clientAddTime(c);
+		return CLIENT_REPLY;
+	}
+
+	while (true)
+	{
+		// Sleeping is a round trip with oss in discrete event mode, so only sleep until an act that does something
+		if (c->des && !c->awake)
+			clientSkipIdle(c);
+
+		// Next time client has something to do, either act or term check. The term check waits for nothing to be in flight, so no
+		// reply is left behind for a client that is gone
+		uint64_t wakeAt = c->nAct;
+		if (c->nInFlight == 0 && c->lastTermChk + TERM_CHECK_NS < wakeAt)
+			wakeAt = c->lastTermChk + TERM_CHECK_NS;
+		uint64_t now = clockNow(c->clock);
+		if (c->des && !c->awake && now < wakeAt)
+		{
+			// Ask oss to reply once the clock reaches wakeAt
+			buf.kind = MSG_SLEEP;
+			buf.wakeAt = wakeAt;
+			c->awaiting = MSG_SLEEP;
+			c->send(c, &buf);
+			return CLIENT_REPLY;
+		}
+		if (!c->des && now < wakeAt)
+		{
+			c->wakeAt = wakeAt;
+			return CLIENT_CLOCK;
+		}
+		c->awake = false;
+
+		// Determine if client should terminate every time it reaches term check (250000000 ns)
+		if (c->nInFlight == 0 && now - c->lastTermChk >= TERM_CHECK_NS)
+		{
+			c->lastTermChk = now;
+			// Once lifetime (2 sec) is reached, randomly generate number up to 100, and terminate if it is below term probability (40)
+			if (now - c->startTimeNs >= LIFE_NS && rand_r(&c->seed) % 100 < TERM_PROB)
+				return CLIENT_EXIT;
+		}
+
+		// Determine if current time has reached time for client to act
+		if (now >= c->nAct)
+		{
+			clientAct(c, now);
+			if (c->nInFlight == c->maxOps)
+				return CLIENT_REPLY;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,113 @@
+// Operating Systems Project 5
+// Description: Layout of the simulated system clock kept in shared memory by oss and attached to by every worker. The clock is a single
+// 64-bit count of nanoseconds so it can be advanced with one atomic add and read with one atomic load from any process, without tearing
+// between a seconds and a nanoseconds field. The segment also holds one wait registration per process table slot so a worker can sleep
+// until the clock reaches a given time, and be woken by oss when it advances the clock past that time. The process table is sized at
+// startup, so the segment is a fixed header followed by a mask with one pending bit per slot and then the registrations.
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "futex.h"
+
+#define NS_PER_SEC 1000000000ULL
+#define CACHE_LINE 64
+
+// Structure for one worker's wait registration
+typedef struct
+{
+	alignas(CACHE_LINE) std::atomic<uint64_t> deadline; // Time the worker wants to be woken at
+	std::atomic<uint32_t> wake; // Bumped by oss when deadline passes. Also the futex word the worker sleeps on
+} ClockWaiter;
+
+// Structure for the header of the shared system clock segment. The counter is aligned to its own cache line so waiters do not share it.
+typedef struct
+{
+	int nWaiters; // Amount of wait registrations in the segment, one per process table slot. Set once by oss
+	std::atomic<uint32_t> ossAsleep; // Set while oss sleeps in event mode until the earliest deadline it has collected
+	alignas(CACHE_LINE) std::atomic<uint64_t> ns; // Simulated time since oss started, in ns
+} SimClock;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared clock requires a lock-free 64-bit atomic");
+
+// Function to get the size of the pending mask for n slots, rounded up so the registrations after it start on a cache line
+inline size_t clockPendingBytes(int n)
+{
+	size_t bytes = (n + 63) / 64 * sizeof(uint64_t);
+	return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// Function to get the size of a clock segment with n wait registrations
+inline size_t clockSize(int n)
+{
+	return sizeof(SimClock) + clockPendingBytes(n) + n * sizeof(ClockWaiter);
+}
+
+// Function to get the pending mask, a bit per slot that registered a deadline oss has not collected yet
+inline std::atomic<uint64_t>* clockPending(SimClock* clk)
+{
+	return (std::atomic<uint64_t>*)(clk + 1);
+}
+
+// Function to get the wait registration for a slot
+inline ClockWaiter* clockWaiter(SimClock* clk, int slot)
+{
+	return (ClockWaiter*)((char*)(clk + 1) + clockPendingBytes(clk->nWaiters)) + slot;
+}
+
+// Function to read the current system time in ns
+inline uint64_t clockNow(SimClock* clk)
+{
+	return clk->ns.load(std::memory_order_relaxed);
+}
+
+// Function to advance the system clock by delta ns and return the new time
+inline uint64_t clockAdvance(SimClock* clk, uint64_t delta)
+{
+	return clk->ns.fetch_add(delta, std::memory_order_relaxed) + delta;
+}
+
+// Functions to split a time in ns into seconds and nanoseconds for printing
+inline unsigned clockSec(uint64_t t) { return (unsigned)(t / NS_PER_SEC); }
+inline unsigned clockNano(uint64_t t) { return (unsigned)(t % NS_PER_SEC); }
+
+// Function for a worker in slot to register deadline for oss to collect. Returns true if oss is asleep until an earliest deadline
+// chosen before this one was registered, so the worker must send it a wake up or oss could sleep past this deadline. Only the first
+// worker to register during a sleep is told to
+inline bool clockRegister(SimClock* clk, int slot, uint64_t deadline)
+{
+	ClockWaiter* w = clockWaiter(clk, slot);
+	w->deadline.store(deadline, std::memory_order_relaxed);
+	clockPending(clk)[slot / 64].fetch_or(1ULL << (slot % 64), std::memory_order_seq_cst);
+	// oss announces its sleep before it collects, so either it sees this registration or this sees it asleep
+	return clk->ossAsleep.load(std::memory_order_seq_cst) != 0 && clk->ossAsleep.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+// Function for a worker in slot to sleep until the system clock reaches the deadline it registered, meaning until oss bumps the wake
+// word and the clock has actually passed the deadline
+inline void clockWaitUntil(SimClock* clk, int slot, uint64_t deadline)
+{
+	ClockWaiter* w = clockWaiter(clk, slot);
+	while (true)
+	{
+		// Read wake word before the clock so a wake between the two makes the futex wait return at once
+		uint32_t gen = w->wake.load(std::memory_order_seq_cst);
+		if (clk->ns.load(std::memory_order_seq_cst) >= deadline)
+			return;
+		futexWait(&w->wake, gen, NULL);
+	}
+}
+
+// Function for oss to wake the worker in slot after its deadline has passed
+inline void clockWake(SimClock* clk, int slot)
+{
+	ClockWaiter* w = clockWaiter(clk, slot);
+	w->wake.fetch_add(1, std::memory_order_seq_cst);
+	futexWake(&w->wake, 1);
+}
+
+#endif
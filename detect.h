@@ -0,0 +1,314 @@
+// Operating Systems Project 5
+// Description: Deadlock detection and recovery planning, kept apart from oss's tables, message queue, and processes so they can be
+// timed on their own by detectbench. Each works on a TableView, which points at the matrices oss keeps: a padded row per resource from
+// matrix.h for allocation and for what processes are waiting on, plus what is available and which slots are in use. A process waiting
+// on several requests at once can have several demands, and goes on once any one of them is met. Nothing here changes the tables or
+// kills anything, oss acts on what is returned.
+
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "matrix.h"
+
+// Structure for a view of the tables detection works on
+typedef struct
+{
+	int m; // Amount of resources
+	int n; // Amount of process slots
+	int stride; // Entries between the start of one resource's row and the next, matrixStride(n)
+	const int* available; // Instances of each resource available
+	const int* allocation; // Instances of each resource each process holds, a row per resource
+	const int* demand; // Instances of each resource each process must get to finish, a row per resource. Outstanding requests for
+	                   // detection, or remaining claims for the banker's safety check
+	const bool* live; // Slot holds a process, the rest are treated as finished
+	int ways; // Demands each process has, any one of which being met lets it finish. Process p's are columns p*ways to p*ways+ways-1
+	int demandStride; // Entries between the start of one resource's demand row and the next, matrixStride(n*ways)
+} TableView;
+
+// Function to find which processes can finish if every process that can have one of its demands met runs and releases what it holds.
+// Uses a worklist instead of rescanning: each demand keeps a count of resources it asks for more of than is available, and each
+// resource keeps the demands short of it sorted by size. When a finishing process adds to work for a resource, the sorted list is
+// advanced past every demand that can now be met, and a process joins the worklist once the count of any of its demands reaches 0.
+// Each process and each of its demands is looked at a bounded number of times, so this is O(n*ways*m) plus sorting.
+// Fills finish for the first n slots, with slots not live counted as finished. Slots marked in gone, if given, are treated as already
+// killed: finished, with everything they hold added to work
+inline void findFinishable(const TableView& t, bool finish[], const bool gone[] = NULL)
+{
+	int m = t.m;
+	int n = t.n;
+	int ways = t.ways;
+	int nd = n * ways; // Demand columns
+
+	// Scratch space kept between calls, since this runs on every grant in avoidance mode
+	static std::vector<int> work; // Represents currently available resources
+	static std::vector<int> unmet; // Amount of resources each demand asks for more of than work
+	static std::vector<int> shortOf; // Demands short of each resource, a row of nd per resource, sorted by size once filled
+	static std::vector<int> nShort; // Amount of demands in shortOf for each resource
+	static std::vector<int> next; // Next demand in shortOf that is not yet met
+	static std::vector<int> ready; // Worklist of processes with a demand that can be met
+	static std::vector<uint64_t> live; // Bitmask of demands of processes still in the table, the rest are treated as finished
+	static std::vector<uint64_t> fits; // Bitmask of demands whose size for one resource fits in work
+	work.resize(m);
+	unmet.resize(nd);
+	shortOf.resize((size_t)m * nd);
+	nShort.resize(m);
+	next.resize(m);
+	ready.resize(n);
+	live.assign(maskWords(nd), 0);
+	fits.resize(maskWords(nd));
+	int nReady = 0;
+
+	// Initialize work to currently available resources
+	for (int i = 0; i < m; i++)
+	{
+		work[i] = t.available[i];
+		nShort[i] = 0;
+		next[i] = 0;
+	}
+
+	// Mark the demands of processes still in the table as live
+	for (int p = 0; p < n; p++)
+	{
+		finish[p] = !t.live[p];
+		for (int c = p * ways; c < (p + 1) * ways; c++)
+			unmet[c] = 0;
+		if (gone != NULL && gone[p] && t.live[p])
+		{
+			// Killed process gives back everything it holds
+			finish[p] = true;
+			for (int i = 0; i < m; i++)
+				work[i] += t.allocation[(size_t)i * t.stride + p];
+		}
+		else if (t.live[p])
+			for (int c = p * ways; c < (p + 1) * ways; c++)
+				live[c / 64] |= 1ULL << (c % 64);
+	}
+
+	// Compare each resource's whole demand row against work at once, counting each demand's unmet resources from the bits that do not fit
+	for (int i = 0; i < m; i++)
+	{
+		fitsMask(&t.demand[(size_t)i * t.demandStride], nd, work[i], fits.data());
+		for (int w = 0; w < maskWords(nd); w++)
+		{
+			uint64_t shortBits = live[w] & ~fits[w];
+			while (shortBits)
+			{
+				int c = w * 64 + __builtin_ctzll(shortBits);
+				shortBits &= shortBits - 1;
+				unmet[c]++;
+				shortOf[(size_t)i * nd + nShort[i]++] = c;
+			}
+		}
+	}
+
+	// Add processes with a demand that is already met to the worklist, marking them finished so none is added twice
+	for (int p = 0; p < n; p++)
+	{
+		for (int c = p * ways; !finish[p] && c < (p + 1) * ways; c++)
+		{
+			if (unmet[c] == 0)
+			{
+				finish[p] = true;
+				ready[nReady++] = p;
+			}
+		}
+	}
+
+	// Sort demands short of each resource by size
+	for (int i = 0; i < m; i++)
+	{
+		const int* dem = &t.demand[(size_t)i * t.demandStride];
+		int* row = &shortOf[(size_t)i * nd];
+		std::sort(row, row + nShort[i], [dem](int a, int b) { return dem[a] < dem[b]; });
+	}
+
+	// Let each process on the worklist finish and release its resources back to work
+	while (nReady > 0)
+	{
+		int p = ready[--nReady];
+		for (int i = 0; i < m; i++)
+		{
+			int held = t.allocation[(size_t)i * t.stride + p];
+			if (held == 0)
+				continue;
+			work[i] += held;
+			// Meet every demand for this resource that now fits in work
+			const int* dem = &t.demand[(size_t)i * t.demandStride];
+			int* row = &shortOf[(size_t)i * nd];
+			while (next[i] < nShort[i] && dem[row[next[i]]] <= work[i])
+			{
+				int c = row[next[i]++];
+				int q = ways == 1 ? c : c / ways;
+				if (--unmet[c] == 0 && !finish[q])
+				{
+					finish[q] = true;
+					ready[nReady++] = q;
+				}
+			}
+		}
+	}
+}
+
+// Function to find the deadlocked processes: those in the table that can never have their requests met. Fills dl with them in slot
+// order and returns the count
+inline int findDeadlocked(const TableView& t, int dl[])
+{
+	static bool* finish = NULL; // Represents which processes can finish (true) and which cannot get requests met (false)
+	static int cap = 0; // Slots finish has room for, it is only reallocated when a bigger table is seen
+	if (cap < t.n)
+	{
+		delete[] finish;
+		finish = new bool[t.n];
+		cap = t.n;
+	}
+	findFinishable(t, finish);
+
+	int cnt = 0;
+	for (int p = 0; p < t.n; p++)
+		if (t.live[p] && !finish[p])
+			dl[cnt++] = p;
+	return cnt;
+}
+
+#define PLAN_EXACT_MAX 12 // Most deadlocked processes planRecovery tries every set of, above that it plans greedily
+
+// Function to find if every process can finish with the processes in gone killed
+inline bool allFinish(const TableView& t, bool finish[], const bool gone[])
+{
+	findFinishable(t, finish, gone);
+	for (int p = 0; p < t.n; p++)
+		if (!finish[p])
+			return false;
+	return true;
+}
+
+// Function to plan which deadlocked processes to kill so that every other process can finish, without killing anything. Kills are
+// simulated by running the reduction again with the victims' resources given back. With up to PLAN_EXACT_MAX deadlocked processes, every
+// set of them is tried and the one with the lowest total cost, then the fewest victims, is chosen, skipping the simulation for any set no
+// cheaper than the best found so far. With more, trying every set takes too long, so the plan is greedy instead: pick the process still
+// stuck that cost rates cheapest until none are, then drop any victim, costliest first, that the rest of the set does not need. That
+// leaves no victim that could be spared, but is not always the cheapest set. Fills victims in slot order and returns the count
+inline int planRecovery(const TableView& t, double (*cost)(int p), int victims[])
+{
+	int n = t.n;
+	bool* gone = new bool[n](); // Processes chosen to be killed
+	bool* finish = new bool[n];
+	std::vector<double> costs(n);
+
+	// Find the deadlocked processes and what killing each costs
+	findFinishable(t, finish, gone);
+	std::vector<int> stuck;
+	for (int p = 0; p < n; p++)
+	{
+		if (!finish[p])
+		{
+			stuck.push_back(p);
+			costs[p] = cost(p);
+		}
+	}
+	int k = stuck.size();
+
+	if (k <= PLAN_EXACT_MAX)
+	{
+		// Every other process finishes whichever are killed, so sets are tried on a table of only the deadlocked processes, with what
+		// the others release already available
+		int subStride = matrixStride(k);
+		int subDemandStride = matrixStride(k * t.ways);
+		int* subAlloc = matrixAlloc(t.m, k);
+		int* subDemand = matrixAlloc(t.m, k * t.ways);
+		std::vector<int> subAvail(t.m);
+		for (int i = 0; i < t.m; i++)
+		{
+			subAvail[i] = t.available[i];
+			for (int p = 0; p < n; p++)
+				if (finish[p] && t.live[p])
+					subAvail[i] += t.allocation[(size_t)i * t.stride + p];
+			for (int j = 0; j < k; j++)
+			{
+				subAlloc[(size_t)i * subStride + j] = t.allocation[(size_t)i * t.stride + stuck[j]];
+				for (int w = 0; w < t.ways; w++)
+					subDemand[(size_t)i * subDemandStride + j * t.ways + w] = t.demand[(size_t)i * t.demandStride + stuck[j] * t.ways + w];
+			}
+		}
+		bool subLive[PLAN_EXACT_MAX];
+		for (int j = 0; j < k; j++)
+			subLive[j] = true;
+		TableView sub = {t.m, k, subStride, subAvail.data(), subAlloc, subDemand, subLive, t.ways, subDemandStride};
+		bool subGone[PLAN_EXACT_MAX];
+		bool subFinish[PLAN_EXACT_MAX];
+
+		// Killing every deadlocked process always works, so start from that and look for a cheaper set that does
+		uint32_t all = (1u << k) - 1;
+		uint32_t best = all;
+		double bestCost = 0;
+		for (int j = 0; j < k; j++)
+			bestCost += costs[stuck[j]];
+		for (uint32_t set = 1; set < all; set++)
+		{
+			double setCost = 0;
+			for (int j = 0; j < k; j++)
+				if (set >> j & 1)
+					setCost += costs[stuck[j]];
+			int cnt = __builtin_popcount(set);
+			if (setCost > bestCost || (setCost == bestCost && cnt >= __builtin_popcount(best)))
+				continue;
+			for (int j = 0; j < k; j++)
+				subGone[j] = set >> j & 1;
+			if (allFinish(sub, subFinish, subGone))
+			{
+				best = set;
+				bestCost = setCost;
+			}
+		}
+		for (int j = 0; j < k; j++)
+			gone[stuck[j]] = best >> j & 1;
+		free(subAlloc);
+		free(subDemand);
+	}
+	else
+	{
+		std::vector<int> order(n); // Victims in the order they were chosen
+		int cnt = 0;
+		while (true)
+		{
+			// Find cheapest process that still cannot finish
+			int victim = -1;
+			for (int p = 0; p < n; p++)
+			{
+				if (finish[p])
+					continue;
+				if (victim < 0 || costs[p] < costs[victim])
+					victim = p;
+			}
+			if (victim < 0)
+				break;
+			gone[victim] = true;
+			order[cnt++] = victim;
+			findFinishable(t, finish, gone);
+		}
+
+		// Sort victims costliest first, then try to spare each one
+		std::sort(order.begin(), order.begin() + cnt, [&costs](int a, int b) { return costs[a] > costs[b]; });
+		for (int v = 0; v < cnt; v++)
+		{
+			gone[order[v]] = false;
+			// Still needed
+			if (!allFinish(t, finish, gone))
+				gone[order[v]] = true;
+		}
+	}
+
+	int kept = 0;
+	for (int p = 0; p < n; p++)
+		if (gone[p])
+			victims[kept++] = p;
+	delete[] gone;
+	delete[] finish;
+	return kept;
+}
+
+#endif
@@ -0,0 +1,515 @@
+// Operating Systems Project 5
+// Description: Microbenchmark for the deadlock detection and recovery planning in detect.h, run without oss, workers, or any IPC.
+// Builds synthetic allocation and request matrices for a chosen amount of processes and resources, with a chosen share of the
+// processes deadlocked in wait-for cycles, then times findDeadlocked and planRecovery on them and reports ns per call. The processes that are not meant
+// to be deadlocked are given requests that can be met in some order, and each deadlocked one asks for more of a resource than could
+// ever be free without the next one in its cycle finishing, so detection must find exactly that share. Checks that it does, and that
+// killing the planned victims leaves every process able to finish.
+// With -v, checks instead that findFinishable finds the same processes able to finish as the original reduction, which rescans from the
+// first process every time one finishes, over random tables of many sizes and densities, with one demand per process or several any
+// of which lets it finish, and that every fitsMask kernel compiled in
+// builds the same mask as the plain loop, and that planRecovery finds the cheapest set of victims when there are few enough deadlocked
+// processes to try every set. Exits with failure on any difference.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include "clock.h"
+#include "detect.h"
+
+using namespace std;
+
+TableView view; // Tables being timed, read by the victim cost
+
+void print_usage(const char * app)
+{
+	fprintf(stdout, "usage: %s [-h] [-n proc] [-m resources] [-u held] [-d percent] [-c cycle] [-r repeats] [-e seed] [-v]\n", app);
+	fprintf(stdout, "      proc is the number of processes in the tables (default 1000)\n");
+	fprintf(stdout, "      resources is the number of resource types (default 20)\n");
+	fprintf(stdout, "      held is the most instances of a resource a process holds, or requests on top of what is free (default 3)\n");
+	fprintf(stdout, "      percent is the share of processes that are deadlocked (default 10)\n");
+	fprintf(stdout, "      cycle is how many deadlocked processes wait on each other in each cycle, about one per cycle is killed (default 4)\n");
+	fprintf(stdout, "      repeats is how many times each kernel is timed (default 20)\n");
+	fprintf(stdout, "      seed seeds the random tables, so a run can be repeated (default 1)\n");
+	fprintf(stdout, "      selecting v checks the kernels against reference versions on random tables from repeats seeds, starting at seed, instead of timing\n");
+}
+
+// Function to get the real time in ns
+uint64_t wallNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+// Function giving the cost of killing process p as the instances it holds, like oss's default
+double costHeld(int p)
+{
+	int held = 0;
+	for (int i = 0; i < view.m; i++)
+		held += view.allocation[(size_t)i * view.stride + p];
+	return held;
+}
+
+// Function to find which processes can finish the way oss first did: scan for a process with a demand that fits in work, let it finish
+// and release what it holds, then restart the scan from the first process. Kept as the reference findFinishable must agree with
+void findFinishableRef(const TableView& t, bool finish[], const bool gone[])
+{
+	vector<int> work(t.available, t.available + t.m);
+	for (int p = 0; p < t.n; p++)
+	{
+		finish[p] = !t.live[p];
+		if (t.live[p] && gone[p])
+		{
+			finish[p] = true;
+			for (int i = 0; i < t.m; i++)
+				work[i] += t.allocation[(size_t)i * t.stride + p];
+		}
+	}
+
+	for (int p = 0; p < t.n; p++)
+	{
+		if (finish[p])
+			continue;
+		bool fits = false;
+		for (int w = 0; w < t.ways && !fits; w++)
+		{
+			fits = true;
+			for (int i = 0; i < t.m && fits; i++)
+				fits = t.demand[(size_t)i * t.demandStride + p * t.ways + w] <= work[i];
+		}
+		if (fits)
+		{
+			finish[p] = true;
+			for (int i = 0; i < t.m; i++)
+				work[i] += t.allocation[(size_t)i * t.stride + p];
+			// Restart loop from 0
+			p = -1;
+		}
+	}
+}
+
+// Function to check findFinishable against findFinishableRef on random tables from repeats seeds starting at seed, over a range of
+// sizes, including ones that are not a multiple of the row padding or mask words, of how many entries are set, and of how many
+// demands each process has. Slots are randomly empty or already killed. Returns the amount of tables where the two differ
+int checkDetection(int seed, int repeats)
+{
+	const int sizes[] = {1, 3, 8, 63, 64, 65, 130, 500};
+	const int resources[] = {1, 4, 20};
+	const int densities[] = {5, 30, 70, 100}; // Percent of allocation and demand entries set
+	const int waysList[] = {1, 3}; // Demands per process
+	int tables = 0;
+	int failed = 0;
+	for (int s = seed; s < seed + repeats; s++)
+	{
+		srand(s);
+		for (int n : sizes)
+		{
+			for (int m : resources)
+			{
+				for (int d : densities)
+				{
+					for (int ways : waysList)
+					{
+						int stride = matrixStride(n);
+						int demStride = matrixStride(n * ways);
+						int* alloc = matrixAlloc(m, n);
+						int* dem = matrixAlloc(m, n * ways);
+						vector<int> avail(m);
+						bool* live = new bool[n];
+						bool* gone = new bool[n];
+						bool* noGone = new bool[n]();
+						bool* finish = new bool[n];
+						bool* ref = new bool[n];
+						for (int p = 0; p < n; p++)
+						{
+							live[p] = rand() % 10 != 0;
+							gone[p] = rand() % 20 == 0;
+							for (int i = 0; i < m; i++)
+							{
+								if (rand() % 100 < d)
+									alloc[(size_t)i * stride + p] = 1 + rand() % 3;
+								for (int w = 0; w < ways; w++)
+									if (rand() % 100 < d)
+										dem[(size_t)i * demStride + p * ways + w] = 1 + rand() % 4;
+							}
+						}
+						for (int i = 0; i < m; i++)
+							avail[i] = rand() % 4;
+						TableView t = {m, n, stride, avail.data(), alloc, dem, live, ways, demStride};
+
+						// Check both with nothing killed and with the random victims
+						for (int withGone = 0; withGone < 2; withGone++)
+						{
+							findFinishable(t, finish, withGone ? gone : NULL);
+							findFinishableRef(t, ref, withGone ? gone : noGone);
+							tables++;
+							for (int p = 0; p < n; p++)
+							{
+								if (finish[p] != ref[p])
+								{
+									fprintf(stderr, "Error! Seed %d, %d processes, %d resources, %d%% set, %d demands each%s: P%d %s, reference %s.\n",
+										s, n, m, d, ways, withGone ? ", with victims" : "", p, finish[p] ? "finishes" : "is stuck",
+										ref[p] ? "finishes" : "is stuck");
+									failed++;
+									break;
+								}
+							}
+						}
+
+						free(alloc);
+						free(dem);
+						delete[] live;
+						delete[] gone;
+						delete[] noGone;
+						delete[] finish;
+						delete[] ref;
+					}
+				}
+			}
+		}
+	}
+	printf("Detection: %d tables checked against the reference reduction, %d differ\n", tables, failed);
+	return failed;
+}
+
+// Function to check every fitsMask kernel compiled in, and the one fitsMask picks, against fitsMaskScalar on random rows from repeats
+// seeds starting at seed, for every length up to a few mask words. The padding past each length is filled with random entries too, so a
+// kernel that lets padding into the mask is caught. Returns the amount of rows where a kernel differs
+int checkKernels(int seed, int repeats)
+{
+	typedef void (*Kernel)(const int* row, int n, int work, uint64_t* mask);
+	vector<pair<const char*, Kernel>> kernels = {{"fitsMask", fitsMask}};
+#ifdef MATRIX_X86
+	kernels.push_back({"SSE2", fitsMaskSse2});
+	if (__builtin_cpu_supports("avx2"))
+		kernels.push_back({"AVX2", fitsMaskAvx2});
+#endif
+	const int maxN = 200;
+	int* row = matrixAlloc(1, maxN);
+	vector<uint64_t> want(maskWords(maxN));
+	vector<uint64_t> got(maskWords(maxN));
+	int rows = 0;
+	int failed = 0;
+	for (int s = seed; s < seed + repeats; s++)
+	{
+		srand(s);
+		for (int n = 1; n <= maxN; n++)
+		{
+			int work = rand() % 6;
+			for (int p = 0; p < matrixStride(n); p++)
+				row[p] = rand() % 8;
+			fitsMaskScalar(row, n, work, want.data());
+			rows++;
+			for (size_t k = 0; k < kernels.size(); k++)
+			{
+				kernels[k].second(row, n, work, got.data());
+				for (int w = 0; w < maskWords(n); w++)
+				{
+					if (got[w] != want[w])
+					{
+						fprintf(stderr, "Error! Seed %d, %d entries: %s mask word %d is %016llx, plain loop %016llx.\n", s, n, kernels[k].first, w,
+							(unsigned long long)got[w], (unsigned long long)want[w]);
+						failed++;
+						break;
+					}
+				}
+			}
+		}
+	}
+	free(row);
+	printf("Masks: %d rows checked with", rows);
+	for (size_t k = 0; k < kernels.size(); k++)
+		printf(" %s", kernels[k].first);
+	printf(" against the plain loop, %d differ\n", failed);
+	return failed;
+}
+
+// Function to check planRecovery on random tables from repeats seeds starting at seed, each with up to PLAN_EXACT_MAX deadlocked
+// processes. Every set of deadlocked processes is tried with findFinishableRef on the whole table, and the plan must let every process
+// finish and cost no more than the cheapest set that does. Returns the amount of tables where it does not
+int checkRecovery(int seed, int repeats)
+{
+	int tables = 0;
+	int failed = 0;
+	for (int s = seed; s < seed + repeats; s++)
+	{
+		srand(s);
+		for (int rep = 0; rep < 50; rep++)
+		{
+			int n = 2 + rand() % 30;
+			int m = 1 + rand() % 5;
+			int ways = 1 + rand() % 2;
+			int stride = matrixStride(n);
+			int demStride = matrixStride(n * ways);
+			int* alloc = matrixAlloc(m, n);
+			int* dem = matrixAlloc(m, n * ways);
+			vector<int> avail(m);
+			bool* live = new bool[n];
+			bool* gone = new bool[n]();
+			bool* finish = new bool[n];
+			for (int p = 0; p < n; p++)
+			{
+				live[p] = rand() % 8 != 0;
+				for (int i = 0; i < m; i++)
+				{
+					if (rand() % 2)
+						alloc[(size_t)i * stride + p] = 1 + rand() % 3;
+					for (int w = 0; w < ways; w++)
+						if (rand() % 2)
+							dem[(size_t)i * demStride + p * ways + w] = 1 + rand() % 5;
+				}
+			}
+			for (int i = 0; i < m; i++)
+				avail[i] = rand() % 3;
+			view = {m, n, stride, avail.data(), alloc, dem, live, ways, demStride};
+
+			vector<int> dl(n);
+			int k = findDeadlocked(view, dl.data());
+			if (k > 0 && k <= PLAN_EXACT_MAX)
+			{
+				// Cheapest set that lets every process finish, found by trying them all
+				double cheapest = -1;
+				for (uint32_t set = 1; set < (1u << k); set++)
+				{
+					double setCost = 0;
+					for (int j = 0; j < k; j++)
+					{
+						gone[dl[j]] = set >> j & 1;
+						if (gone[dl[j]])
+							setCost += costHeld(dl[j]);
+					}
+					findFinishableRef(view, finish, gone);
+					bool all = true;
+					for (int p = 0; p < n; p++)
+						all = all && finish[p];
+					if (all && (cheapest < 0 || setCost < cheapest))
+						cheapest = setCost;
+				}
+
+				vector<int> victims(n);
+				int cnt = planRecovery(view, costHeld, victims.data());
+				double planCost = 0;
+				for (int p = 0; p < n; p++)
+					gone[p] = false;
+				for (int v = 0; v < cnt; v++)
+				{
+					gone[victims[v]] = true;
+					planCost += costHeld(victims[v]);
+				}
+				findFinishableRef(view, finish, gone);
+				bool all = true;
+				for (int p = 0; p < n; p++)
+					all = all && finish[p];
+				tables++;
+				if (!all || planCost > cheapest)
+				{
+					fprintf(stderr, "Error! Seed %d, table %d: plan of %d victims costs %.0f%s, cheapest set costs %.0f.\n", s, rep, cnt,
+						planCost, all ? "" : " and leaves processes stuck", cheapest);
+					failed++;
+				}
+			}
+
+			free(alloc);
+			free(dem);
+			delete[] live;
+			delete[] gone;
+			delete[] finish;
+		}
+	}
+	printf("Recovery: %d deadlocked tables checked against every set of victims, %d plans not the cheapest\n", tables, failed);
+	return failed;
+}
+
+int main(int argc, char* argv[])
+{
+	int n = 1000, m = 20, maxHeld = 3, percent = 10, cycle = 4, repeats = 20, seed = 1;
+	bool verify = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hn:m:u:d:c:r:e:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': // Help
+				print_usage(argv[0]);
+				return EXIT_SUCCESS;
+			case 'v': // Check kernels instead of timing
+				verify = true;
+				break;
+			case 'n': // Numeric options
+			case 'm':
+			case 'u':
+			case 'd':
+			case 'c':
+			case 'r':
+			case 'e':
+				// Loop to ensure all characters in argument are digits
+				for (int i = 0; optarg[i] != '\0'; i++)
+				{
+					if (!isdigit(optarg[i]))
+					{
+						fprintf(stderr, "Error! %s is not a valid number.\n", optarg);
+						print_usage(argv[0]);
+						return EXIT_FAILURE;
+					}
+				}
+				if (opt == 'n')
+					n = atoi(optarg);
+				else if (opt == 'm')
+					m = atoi(optarg);
+				else if (opt == 'u')
+					maxHeld = atoi(optarg);
+				else if (opt == 'd')
+					percent = atoi(optarg);
+				else if (opt == 'c')
+					cycle = atoi(optarg);
+				else if (opt == 'r')
+					repeats = atoi(optarg);
+				else
+					seed = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Error! Invalid option %c.\n", optopt);
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (n < 1 || m < 1 || maxHeld < 1 || cycle < 1 || percent > 100 || repeats < 1)
+	{
+		fprintf(stderr, "Error! proc, resources, held, cycle, and repeats must be at least 1, and percent at most 100.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Check the kernels against their reference versions instead of timing
+	if (verify)
+	{
+		int failed = checkKernels(seed, repeats);
+		failed += checkDetection(seed, repeats);
+		failed += checkRecovery(seed, repeats);
+		return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	srand(seed);
+
+	// Tables laid out as oss keeps them, a padded row per resource
+	int stride = matrixStride(n);
+	int* alloc = matrixAlloc(m, n);
+	int* req = matrixAlloc(m, n);
+	vector<int> available(m);
+	bool* live = new bool[n];
+	if (alloc == NULL || req == NULL)
+	{
+		fprintf(stderr, "Error! Failed to allocate tables.\n");
+		return EXIT_FAILURE;
+	}
+
+	// Choose which processes are deadlocked, the first dead of a shuffled order
+	vector<int> order(n);
+	for (int p = 0; p < n; p++)
+		order[p] = p;
+	for (int k = n - 1; k > 0; k--)
+		swap(order[k], order[rand() % (k + 1)]);
+	int dead = n * percent / 100;
+
+	// Every process holds some instances of about a third of the resources, with a few instances of each left free
+	for (int p = 0; p < n; p++)
+	{
+		live[p] = true;
+		for (int i = 0; i < m; i++)
+			if (rand() % 3 == 0)
+				alloc[(size_t)i * stride + p] = 1 + rand() % maxHeld;
+	}
+	vector<int> work(m);
+	for (int i = 0; i < m; i++)
+		work[i] = available[i] = rand() % (maxHeld + 1);
+
+	// Processes that are not deadlocked, in order, request no more than is free once the ones before them finish
+	for (int k = dead; k < n; k++)
+	{
+		int p = order[k];
+		for (int i = 0; i < m; i++)
+			if (rand() % 3 == 0)
+				req[(size_t)i * stride + p] = rand() % (work[i] + 1);
+		for (int i = 0; i < m; i++)
+			work[i] += alloc[(size_t)i * stride + p];
+	}
+
+	// Deadlocked processes form wait-for cycles of cycle processes. Each holds only some of one resource, taken in turn so cycles share
+	// resources as little as they can, and requests the next one's resource: as much as is free once every other process has finished
+	// plus what the next one holds. None can go on until one in its cycle is killed, and then the rest of that cycle can, so about one
+	// victim per cycle is needed, fewer once there are more deadlocked processes than resources and cycles free each other
+	for (int k = 0; k < dead; k++)
+		for (int i = 0; i < m; i++)
+			alloc[(size_t)i * stride + order[k]] = 0;
+	for (int k = 0; k < dead; k += cycle)
+	{
+		int len = min(cycle, dead - k);
+		vector<int> res(len);
+		for (int j = 0; j < len; j++)
+		{
+			res[j] = (k + j) % m;
+			alloc[(size_t)res[j] * stride + order[k + j]] = 1 + rand() % maxHeld;
+		}
+		for (int j = 0; j < len; j++)
+		{
+			int next = (j + 1) % len;
+			int i = res[next];
+			req[(size_t)i * stride + order[k + j]] = work[i] + alloc[(size_t)i * stride + order[k + next]];
+		}
+	}
+
+	view = {m, n, stride, available.data(), alloc, req, live, 1, stride};
+	printf("Tables: %d processes, %d resources, %d deadlocked (%d%%) in cycles of %d\n", n, m, dead, percent, cycle);
+
+	// Time detection, checking it finds exactly the deadlocked processes
+	vector<int> dl(n);
+	int found = 0;
+	uint64_t start = wallNow();
+	for (int r = 0; r < repeats; r++)
+		found = findDeadlocked(view, dl.data());
+	uint64_t detectNs = (wallNow() - start) / repeats;
+	if (found != dead)
+	{
+		fprintf(stderr, "Error! Detection found %d deadlocked processes, expected %d.\n", found, dead);
+		return EXIT_FAILURE;
+	}
+	printf("Detection: %llu ns per run over %d runs, %d deadlocked found\n", (unsigned long long)detectNs, repeats, found);
+
+	// Time victim selection, checking the plan ends the deadlock
+	vector<int> victims(n);
+	int cnt = 0;
+	start = wallNow();
+	for (int r = 0; r < repeats; r++)
+		cnt = planRecovery(view, costHeld, victims.data());
+	uint64_t planNs = (wallNow() - start) / repeats;
+
+	bool* gone = new bool[n]();
+	bool* finish = new bool[n];
+	for (int v = 0; v < cnt; v++)
+		gone[victims[v]] = true;
+	findFinishable(view, finish, gone);
+	for (int p = 0; p < n; p++)
+	{
+		if (!finish[p])
+		{
+			fprintf(stderr, "Error! P%d is still deadlocked after killing the planned victims.\n", p);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("Victim selection: %llu ns per plan over %d runs, %d victims, %s\n", (unsigned long long)planNs, repeats, cnt,
+		found <= PLAN_EXACT_MAX ? "cheapest set" : "greedy");
+
+	delete[] gone;
+	delete[] finish;
+	delete[] live;
+	free(alloc);
+	free(req);
+	return EXIT_SUCCESS;
+}
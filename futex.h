@@ -0,0 +1,29 @@
+// Operating Systems Project 5
+// Description: Thin wrappers around the futex system call used to put oss and workers to sleep on a word in shared memory. The futexes are
+// not private since the words they wait on are shared between processes.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex word must be a plain 32-bit integer");
+
+// Function to sleep while *addr still equals val, or until timeout (NULL means forever) passes or a signal arrives
+inline long futexWait(std::atomic<uint32_t>* addr, uint32_t val, const struct timespec* timeout)
+{
+	return syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+// Function to wake up to n sleepers waiting on addr
+inline long futexWake(std::atomic<uint32_t>* addr, int n)
+{
+	return syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+#endif
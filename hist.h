@@ -0,0 +1,82 @@
+// Operating Systems Project 5
+// Description: Histogram oss keeps latencies in, so it can report percentiles at exit without keeping every sample. Buckets are log
+// linear, as in HDR histograms: values below HIST_SUBS get a bucket each, and every power of 2 above that is split into HIST_SUBS equal
+// buckets, so any value from 0 to 2^64 - 1 is kept to within 1 part in HIST_SUBS in a fixed table. Recording is a count of leading
+// zeros, a shift, and an add.
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUBS (1 << HIST_SUB_BITS) // Buckets per power of 2, values are kept to within about 3%
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUBS)
+
+// Structure for a histogram of values
+typedef struct
+{
+	uint64_t counts[HIST_BUCKETS]; // Values recorded in each bucket
+	uint64_t total; // Values recorded
+	uint64_t min; // Smallest value recorded, exact
+	uint64_t max; // Largest value recorded, exact
+	double sum; // Sum of values recorded, for the mean
+} Histogram;
+
+// Function to get the bucket v is counted in
+inline int histBucket(uint64_t v)
+{
+	if (v < HIST_SUBS)
+		return (int)v;
+	int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUBS + (int)((v >> shift) - HIST_SUBS);
+}
+
+// Function to get the largest value counted in bucket b
+inline uint64_t histHigh(int b)
+{
+	if (b < HIST_SUBS)
+		return b;
+	int shift = b / HIST_SUBS - 1;
+	return (((uint64_t)(b % HIST_SUBS + HIST_SUBS + 1)) << shift) - 1;
+}
+
+// Function to record value v
+inline void histRecord(Histogram* h, uint64_t v)
+{
+	h->counts[histBucket(v)]++;
+	if (h->total == 0 || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->total++;
+	h->sum += v;
+}
+
+// Function to get the value at or below which fraction q of recorded values lie, accurate to the bucket it falls in. Returns 0 if
+// nothing was recorded
+inline uint64_t histPercentile(const Histogram* h, double q)
+{
+	if (h->total == 0)
+		return 0;
+	// Rank of the value wanted, rounded up, as in the nearest rank method
+	uint64_t rank = (uint64_t)(q * h->total);
+	if (rank < q * h->total || rank < 1)
+		rank++;
+	uint64_t seen = 0;
+	for (int b = 0; b < HIST_BUCKETS; b++)
+	{
+		seen += h->counts[b];
+		if (seen >= rank)
+			return histHigh(b) < h->max ? histHigh(b) : h->max;
+	}
+	return h->max;
+}
+
+// Function to get the mean of recorded values, 0 if nothing was recorded
+inline double histMean(const Histogram* h)
+{
+	return h->total == 0 ? 0 : h->sum / h->total;
+}
+
+#endif
@@ -0,0 +1,242 @@
+// Operating Systems Project 5
+// Description: Logger used by oss for its console and logfile output. Each piece of output is formatted once, by the caller, into a ring
+// of bytes, and a writer thread drains the ring to stdout and the logfile with large writes, so handling a message never waits on the
+// terminal. Only the oss main thread logs and only the writer drains, so the ring needs no locks: oss only moves tail and the writer only
+// moves head. Output is split into levels, and logging calls above LOG_LEVEL are compiled out along with their arguments.
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+#define LOG_STATS 0 // Final statistics, always built in
+#define LOG_INFO 1 // Tables, deadlock detection and recovery, and terminations
+#define LOG_MSG 2 // A line for every request, grant, release, and wait
+
+// Most detailed level built in, build with -DLOG_LEVEL=LOG_INFO to compile out the per-message lines
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_MSG
+#endif
+
+#define LOG_RING_SIZE (1u << 20) // Bytes the ring holds, a power of 2
+#define LOG_LINE_MAX 1024 // Longest piece of output one call can format
+#define LOG_BATCH (LOG_RING_SIZE / 4) // Bytes buffered before the writer is woken early
+#define LOG_FLUSH_NS 20000000 // Longest the writer sleeps before writing out whatever is buffered
+
+// Structure for the logger's state
+typedef struct
+{
+	char* ring; // LOG_RING_SIZE bytes of formatted output
+	alignas(64) std::atomic<uint32_t> tail; // Bytes ever added by oss
+	alignas(64) std::atomic<uint32_t> head; // Bytes ever written out by the writer
+	std::atomic<uint32_t> waiting; // Set while the writer is asleep, so oss only makes a wake call when one is needed
+	std::atomic<uint32_t> stop; // Set once oss is done logging, the writer drains the ring and exits
+	std::atomic<int> fileFd; // Logfile, -1 if output only goes to stdout
+	pthread_t writer; // Writer thread
+	pid_t owner; // Process that started the writer, so a forked child that exits does not try to stop it
+	bool started; // Writer is running
+} Logger;
+
+inline Logger logger = {NULL, {0}, {0}, {0}, {0}, -1, 0, 0, false};
+
+// Function to write all n bytes at p to fd, retrying short and interrupted writes
+inline void logWriteAll(int fd, const char* p, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t w = write(fd, p, n);
+		if (w < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += w;
+		n -= w;
+	}
+}
+
+// Function to write n bytes at p to stdout and the logfile if there is one
+inline void logWriteSinks(const char* p, size_t n)
+{
+	logWriteAll(STDOUT_FILENO, p, n);
+	int fd = logger.fileFd.load(std::memory_order_acquire);
+	if (fd >= 0)
+		logWriteAll(fd, p, n);
+}
+
+// Function run by the writer thread. Sleeps until LOG_BATCH bytes are buffered, LOG_FLUSH_NS passes, or oss stops, then writes out
+// everything buffered with one write per sink, or two if the bytes wrap around the end of the ring
+inline void* logWriter(void*)
+{
+	while (true)
+	{
+		bool stopping = logger.stop.load(std::memory_order_acquire);
+		uint32_t head = logger.head.load(std::memory_order_relaxed);
+		uint32_t tail = logger.tail.load(std::memory_order_acquire);
+		if (tail == head && stopping)
+			return NULL;
+
+		// Wait for more output unless a batch is ready or oss is done
+		if (tail - head < LOG_BATCH && !stopping)
+		{
+			struct timespec timeout = {0, LOG_FLUSH_NS};
+			logger.waiting.store(1, std::memory_order_seq_cst);
+			if (!logger.stop.load(std::memory_order_seq_cst))
+				futexWait(&logger.tail, tail, &timeout);
+			logger.waiting.store(0, std::memory_order_relaxed);
+			tail = logger.tail.load(std::memory_order_acquire);
+		}
+
+		uint32_t pos = head % LOG_RING_SIZE;
+		uint32_t len = tail - head;
+		uint32_t first = len < LOG_RING_SIZE - pos ? len : LOG_RING_SIZE - pos;
+		logWriteSinks(logger.ring + pos, first);
+		logWriteSinks(logger.ring, len - first);
+		logger.head.store(tail, std::memory_order_release);
+	}
+}
+
+// Function to add n bytes to the ring, waiting for room if the writer has fallen behind. n is at most LOG_RING_SIZE
+inline void logPush(const char* p, uint32_t n)
+{
+	uint32_t tail = logger.tail.load(std::memory_order_relaxed);
+	while (tail + n - logger.head.load(std::memory_order_acquire) > LOG_RING_SIZE)
+	{
+		if (logger.waiting.exchange(0, std::memory_order_seq_cst))
+			futexWake(&logger.tail, 1);
+		sched_yield();
+	}
+
+	// Copy the bytes in, in two pieces if they wrap around the end of the ring
+	uint32_t pos = tail % LOG_RING_SIZE;
+	uint32_t first = n < LOG_RING_SIZE - pos ? n : LOG_RING_SIZE - pos;
+	memcpy(logger.ring + pos, p, first);
+	memcpy(logger.ring, p + first, n - first);
+	logger.tail.store(tail + n, std::memory_order_seq_cst);
+
+	// Wake the writer early once a full batch is waiting
+	if (tail + n - logger.head.load(std::memory_order_relaxed) >= LOG_BATCH && logger.waiting.exchange(0, std::memory_order_seq_cst))
+		futexWake(&logger.tail, 1);
+}
+
+// Function to format a piece of output and add it to the ring. Called through the log macros, only from the oss main thread. Before
+// the writer is started, output goes straight to stdout
+inline void logPrintf(const char* fmt, ...)
+{
+	char line[LOG_LINE_MAX];
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	if (n <= 0)
+		return;
+	if (n >= LOG_LINE_MAX)
+		n = LOG_LINE_MAX - 1;
+	if (!logger.started)
+		logWriteSinks(line, n);
+	else
+		logPush(line, n);
+}
+
+// Function to add n bytes the caller has already formatted, of any length, with no copy through a line buffer. Used for output too long
+// for one logPrintf, such as the tables. Before the writer is started, it is written straight to stdout
+inline void logWrite(const char* p, size_t n)
+{
+	if (!logger.started)
+	{
+		logWriteSinks(p, n);
+		return;
+	}
+	// Output longer than the ring goes in pieces the writer drains in between
+	while (n > 0)
+	{
+		uint32_t piece = n < LOG_RING_SIZE / 2 ? n : LOG_RING_SIZE / 2;
+		logPush(p, piece);
+		p += piece;
+		n -= piece;
+	}
+}
+
+// Function to have the writer drain everything logged so far and exit, then close the logfile. Registered with atexit, so output is
+// not lost on any exit path. Does nothing in a forked child, which does not have the writer thread
+inline void logStop()
+{
+	if (!logger.started || getpid() != logger.owner)
+		return;
+	logger.stop.store(1, std::memory_order_seq_cst);
+	futexWake(&logger.tail, 1);
+	pthread_join(logger.writer, NULL);
+	logger.started = false;
+	if (logger.fileFd >= 0)
+		close(logger.fileFd);
+	logger.fileFd.store(-1);
+}
+
+// Function to start the writer thread. The writer blocks every signal so they are all handled on the oss main thread. Returns false if
+// the ring could not be allocated or the thread could not be started, in which case output is written directly
+inline bool logStart()
+{
+	logger.ring = (char*)malloc(LOG_RING_SIZE);
+	if (logger.ring == NULL)
+		return false;
+
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	bool ok = pthread_create(&logger.writer, NULL, logWriter, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (!ok)
+		return false;
+
+	logger.owner = getpid();
+	logger.started = true;
+	atexit(logStop);
+	return true;
+}
+
+// Function to also send output to the file at path, replacing it. Returns false if it cannot be opened
+inline bool logOpenFile(const char* path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	// Writer reads the descriptor between batches, so drain what is buffered first to keep the file starting here
+	while (logger.started && logger.head.load(std::memory_order_acquire) != logger.tail.load(std::memory_order_relaxed))
+	{
+		if (logger.waiting.exchange(0, std::memory_order_seq_cst))
+			futexWake(&logger.tail, 1);
+		sched_yield();
+	}
+	logger.fileFd.store(fd, std::memory_order_release);
+	return true;
+}
+
+// Macros for each level of output. Levels above LOG_LEVEL expand to nothing, so their arguments are never evaluated
+#define logStat(...) logPrintf(__VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...) logPrintf(__VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_MSG
+#define logMsg(...) logPrintf(__VA_ARGS__)
+#else
+#define logMsg(...) ((void)0)
+#endif
+
+#endif
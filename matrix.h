@@ -0,0 +1,107 @@
+// Operating Systems Project 5
+// Description: Kernel used by deadlock detection to compare a whole row of the request matrix against the amount of a resource available.
+// oss keeps requests and allocations as dense rows, one per resource, with a process's entry at its slot index and each row padded with
+// zeros out to a multiple of MATRIX_LANES. That lets the kernel load MATRIX_LANES entries at a time with no tail loop and turn the
+// comparisons into a bitmask of processes whose request fits, bit p for slot p. AVX2 is used when the CPU has it, SSE2 otherwise, and a
+// plain loop on other architectures.
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86
+#endif
+
+#define MATRIX_LANES 8 // Entries per AVX2 vector, rows are padded to a multiple of this
+
+// Function to round an amount of processes up to a padded row length
+constexpr int matrixStride(int n)
+{
+	return (n + MATRIX_LANES - 1) / MATRIX_LANES * MATRIX_LANES;
+}
+
+// Function to get the amount of 64-bit words in a mask covering n processes
+constexpr int maskWords(int n)
+{
+	return (n + 63) / 64;
+}
+
+// Function to allocate a zeroed matrix of rows rows, each padded for n processes, as one block aligned to a cache line. Returns NULL if
+// out of memory
+inline int* matrixAlloc(int rows, int n)
+{
+	size_t bytes = (size_t)rows * matrixStride(n) * sizeof(int);
+	void* mat = NULL;
+	if (posix_memalign(&mat, 64, bytes == 0 ? 64 : bytes) != 0)
+		return NULL;
+	memset(mat, 0, bytes);
+	return (int*)mat;
+}
+
+// Function to set bit p of mask for every p < n where row[p] <= work, using a plain loop
+inline void fitsMaskScalar(const int* row, int n, int work, uint64_t* mask)
+{
+	for (int w = 0; w < maskWords(n); w++)
+		mask[w] = 0;
+	for (int p = 0; p < n; p++)
+		if (row[p] <= work)
+			mask[p / 64] |= 1ULL << (p % 64);
+}
+
+#ifdef MATRIX_X86
+// Function to build the mask 4 entries at a time with SSE2, which every x86-64 CPU has
+inline void fitsMaskSse2(const int* row, int n, int work, uint64_t* mask)
+{
+	__m128i w = _mm_set1_epi32(work);
+	for (int i = 0; i < maskWords(n); i++)
+		mask[i] = 0;
+	for (int p = 0; p < n; p += 4)
+	{
+		// Lanes where request > work, flipped to get lanes that fit
+		__m128i gt = _mm_cmpgt_epi32(_mm_load_si128((const __m128i*)(row + p)), w);
+		uint64_t fits = ~_mm_movemask_ps(_mm_castsi128_ps(gt)) & 0xF;
+		mask[p / 64] |= fits << (p % 64);
+	}
+	// Clear the bits that came from padding
+	if (n % 64)
+		mask[n / 64] &= (1ULL << (n % 64)) - 1;
+}
+
+// Function to build the mask 8 entries at a time with AVX2. Compiled for AVX2 on its own so the rest of the program does not need it
+__attribute__((target("avx2"))) inline void fitsMaskAvx2(const int* row, int n, int work, uint64_t* mask)
+{
+	__m256i w = _mm256_set1_epi32(work);
+	for (int i = 0; i < maskWords(n); i++)
+		mask[i] = 0;
+	for (int p = 0; p < n; p += 8)
+	{
+		__m256i gt = _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i*)(row + p)), w);
+		uint64_t fits = ~_mm256_movemask_ps(_mm256_castsi256_ps(gt)) & 0xFF;
+		mask[p / 64] |= fits << (p % 64);
+	}
+	if (n % 64)
+		mask[n / 64] &= (1ULL << (n % 64)) - 1;
+}
+#endif
+
+// Function to set bit p of mask for every process p < n whose entry in row is at most work. row must be aligned to 32 bytes and padded
+// to matrixStride(n) entries
+inline void fitsMask(const int* row, int n, int work, uint64_t* mask)
+{
+#ifdef MATRIX_X86
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2)
+		fitsMaskAvx2(row, n, work, mask);
+	else
+		fitsMaskSse2(row, n, work, mask);
+#else
+	fitsMaskScalar(row, n, work, mask);
+#endif
+}
+
+#endif
@@ -5,8 +5,8 @@
 // Description: A program that simulates a resource management operating system with deadlock detection and recovery.
 // This program runs until it has forked the total amount of processes specified in the command line, while allowing a
 // specified amount of processes to run simultanously. It will allocate shared memory to represent a system clock. It will
-// also keep track of a process control block table for all processes and a resource table for 5 resource types with 10 
-// instances each. It will receive messages from child processes that represent a resource request or release. If it 
+// also keep track of a process control block table for all processes and a resource table, sized at startup from the command line
+// or a config file (5 resource types with 10 instances each by default). It will receive messages from child processes that represent a resource request or release. If it 
 // receives a request, it will grant the request if possible or it will add the child to a wait queue if not possible.
 // When requests/releases are received, it will update values in both tables to reflect this. It will print both tables 
 // every .5 sec of system time. It will run a deadlock detection algorithm every 1 sec of system time. If a deadlock is
@@ -25,14 +25,33 @@
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <spawn.h>
 #include <time.h>
 #include <string>
 #include <queue>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <algorithm>
+
+#include "clock.h"
+#include "transport.h"
+#include "matrix.h"
+#include "pidmap.h"
+#include "log.h"
+#include "trace.h"
+#include "hist.h"
+#include "stats.h"
+#include "detect.h"
+#include "tasks.h"
 
 #define PERMS 0644
-#define MAX_RES 5
-#define INST_PER_RES 10
-#define MAX_PROC 18
+#define DEF_RES 5 // Resource types when not set with -m or a config file
+#define DEF_INST 10 // Instances of each resource when not set with -u or a config file
+#define NOT_WAITING -2 // Marks a process as not in a resource's wait queue
+#define CLOCK_STEP_NS 10000000 // Simulated time each pass of the main loop adds to the clock
+#define EVENT_TICK_NS 1000000 // Real time oss sleeps in event mode for each clock step it lets pass
+#define EVENT_IDLE_NS 100000000 // Longest real time oss sleeps in event mode, in case a child exit signal lands just before the sleep
 
 using namespace std;
 
@@ -43,8 +62,31 @@ typedef struct
 	int simul;
 	long long interval;
 	string logfile;
+	bool event; // Sleep until there is work instead of polling
+	bool ring; // Use shared memory ring transport instead of message queue
+	bool clockWait; // Workers sleep on the clock instead of spinning
+	bool des; // Discrete event mode
+	bool incremental; // Detect deadlock as processes block instead of every second
+	bool avoid; // Only grant requests that leave the system in a safe state
+	int resources; // Amount of resource types
+	vector<int> instances; // Instances of each resource type, the last one repeats for any types not listed
+	int burst; // Most instances a worker asks for in one request
+	int ops; // Most requests and releases a worker keeps in flight
+	int threads; // Threads running workers as tasks inside oss, 0 to fork a worker process for each
+	bool pool; // Keep worker processes in a pool and start new lifetimes in them instead of launching new ones
 } options_t;
 
+// Structure for a request that has not been fully granted yet
+typedef struct
+{
+	uint32_t seq; // Worker's number for the request, sent back with the grant so the worker can match it
+	bool partial; // Request takes instances as they free up instead of all at once
+	int nUnits; // Amount of pairs in units
+	ResUnits units[MSG_UNITS]; // Resources requested and how many of each are still to be granted
+	uint64_t waitSince; // Simulated time request was queued
+	uint64_t waitSinceWall; // Real time request was queued
+} PendingOp;
+
 // Structure for Process Control Block
 typedef struct 
 {
@@ -52,8 +94,11 @@ typedef struct
 	pid_t pid; // Process ID of this child
 	int startSeconds; // Time when it was forked
 	int startNano; // Time when it was forked
-	int held[5] = {0};
-	int waitingOn = -1;
+	int* held; // How many of each resource process holds, this slot's row of heldMat
+	PendingOp* ops; // Requests not yet fully granted in the order they arrived, this slot's row of opMat
+	int nPending = 0; // Amount of requests in ops. Process is blocked for deadlock detection once this reaches maxOps
+	uint64_t blockedSince; // Simulated time process last became blocked
+	uint64_t blockedNs; // Simulated time process has spent blocked
 } PCB;
 
 // Structure to hold resources in the system
@@ -61,38 +106,95 @@ typedef struct
 {
 	int total; // Total instances of resource
 	int available; // Amount currently available
-	int allocation[MAX_PROC] = {0}; // How many resources held by process
-	int request[MAX_PROC] = {0}; // How many requests from proces
-	queue<int> waitQueue; // Holds processes waiting for resources
+	int* allocation; // How many resources held by process, this resource's row of allocMat
+	int* request; // How many requests from proces, this resource's row of reqMat
+	int* need; // How many more each process may request before reaching its claim, this resource's row of needMat. Only kept in avoidance mode
+	int waitHead = -1; // First process waiting for resource, -1 if none
+	int waitTail = -1; // Last process waiting for resource, -1 if none
+	int waitLen = 0; // Amount of processes waiting for resource
+	int* waitNext; // Process after each process in the wait queue, this resource's row of waitNextMat
+	int* waitPrev; // Process before each process in the wait queue, or NOT_WAITING, this resource's row of waitPrevMat
+	int* holders; // Processes holding at least one instance, in no particular order
+	int nHolders = 0; // Amount of processes in holders
+	int* holderPos; // Position of each process in holders, -1 if it holds none
+	int maxWaitLen = 0; // Longest the wait queue has been
+	int maxInUse = 0; // Most instances held at once
+	uint64_t busyArea = 0; // Instances held multiplied by the simulated ns they were held for, up to lastChange
+	uint64_t lastChange = 0; // Simulated time available last changed
 } Resource;
 
-// Message buffer for communication between OSS and child processes
-typedef struct msgbuffer 
-{
-	long mtype; // Message type used for message queue
-	pid_t pid;
-	int resId; // Which resource
-	bool isRelease; // False means requested, true means release
-	bool granted; // Grant resources to worker
-} msgbuffer;
-
 // Global variables
 PCB* processTable; // Process control block table to track child processes
 Resource* resTable;
 
+int nProc; // Amount of process table slots, the most processes that can run at once
+int nRes; // Amount of resource types
+
+// Allocation, request, and need matrices, one padded row per resource so deadlock detection can compare a row against available in
+// vectors. Each is one contiguous block sized at startup
+int* allocMat;
+int* reqMat;
+int* needMat;
+int* waitMat; // Pending requests of blocked processes for detection, a column per slot and request, since a blocked process goes on once
+              // any one is granted. Only kept with more than one request in flight, otherwise reqMat holds the same
+int* heldMat; // Resources held by each process, one row per slot
+int* holderMat; // Holder list of each resource, one row per resource
+int* holderPosMat; // Position of each process in its resource's holder list, one row per resource
+int* waitNextMat; // Wait queue links of each resource, one row per resource
+int* waitPrevMat;
+PendingOp* opMat; // Pending requests of each process, one row of maxOps per slot
+int maxOps = 1; // Most requests and releases each worker keeps in flight at once
+char* snapBuf; // Buffer printInfo renders the tables into, sized at startup by snapBytes
+char* snapRows; // Resource table rows, rendered by printInfo in the same pass as the process table and copied after it
+int* lastHeldMat; // Resources held by each slot at the last print, one row per slot. Only kept in delta mode
+pid_t* lastPid; // Pid in each slot at the last print, 0 if it was empty. Only kept in delta mode
+bool deltaPrint = false; // Only print table rows that changed since the last print
+bool* freed; // Resources given back by exited or killed processes that have not been offered to waiters yet
+PidMap pidMap; // Index from each running worker's pid to its process table slot
+
 int running; // Amount of running processes in system
 
-int *shm_ptr; // Shared memory pointer to store system clock
+SimClock *shm_ptr; // Shared memory pointer to store system clock
 int shm_id; // Shared memory ID
 
 int msqid; // Queue ID for communication
 msgbuffer buf; // Message buffer to send messages
 msgbuffer rcvbuf; // Message buffer to receive messages
 
-bool logging = false; // Bool to determine if output should also print to logfile
-FILE* logfile = NULL; // Pointer to logfile
+Transport* ring = NULL; // Shared memory transport, NULL when using the message queue
+bool tasks = false; // Workers run as tasks on threads inside oss instead of as processes, with their transport on the heap
+pid_t nextTaskPid = 1; // Id for the next task, standing in for a pid. Counts up so no id is reused within a run
+bool pool = false; // Worker processes tell oss when a lifetime ends and wait to be started again instead of exiting
+vector<pid_t> idleWorkers; // Pooled worker processes waiting for a new lifetime, taken from the back
+vector<int> freeSlots; // Process table slots not in use, taken from the back
+vector<string> workerArgs; // Arguments every worker process is launched with after its slot
+
+bool clockWaits = false; // Workers sleep until their next deadline instead of spinning on the clock
+bool des = false; // Discrete event mode, clock jumps to next event once every worker is blocked
+int active = 0; // Workers in discrete event mode that are running rather than waiting on a reply from oss
+
+// Structure for a worker waiting for the clock to reach a time
+typedef struct Deadline
+{
+	uint64_t at; // Time to wake worker
+	int slot; // Process table slot of worker
+	pid_t pid; // Pid of worker, so a deadline left by a worker that is gone does not wake the next one in its slot
+	uint32_t seq; // Sequence number of the request or release whose reply is held until then, 0 for a sleep
+	bool operator>(const Deadline& o) const { return at > o.at; }
+} Deadline;
+priority_queue<Deadline, vector<Deadline>, greater<Deadline> > deadlines; // Worker deadlines, earliest first
+int ring_id; // Shared memory ID of transport
+Stats* stats = NULL; // Live statistics segment read by ossstat
+int stats_id; // Shared memory ID of live statistics
+
+volatile sig_atomic_t childExited = 0; // Set by SIGCHLD handler so event mode knows to reap
+volatile sig_atomic_t timeUp = 0; // Set by the alarm once oss has run for 3 seconds of real time
+timer_t wakeTimer; // Ends an event mode sleep on the message queue at its deadline
+uint64_t sleepNs = 0; // Real time the current event mode sleep lasts, for a sleep on the ring
+
 
 // Variables to determine final statistics
+int msgsHandled = 0; // Amount of messages received from workers
 int immGrant = 0; // Amount of resource requests immediately granted
 int waitGrant = 0; // Amount of resource requests granted after process waited
 int regTerms = 0; // Amount of processes that terminated normally on their own
@@ -100,41 +202,91 @@ int dlRuns = 0; // Amount of times deadlock detection alg was run
 int dlKills = 0; // Amount of processes killed by deadlock recovery alg
 int totDlProcs = 0; // Total amount of processes that became deadlocked
 int dlCnt = 0; // Number of processes in each deadlock run
-int lastDl[MAX_PROC]; // Holds the pids of processes in each deadlock
+int* lastDl; // Holds the pids of processes in each deadlock
+
+Histogram waitSimHist; // Simulated ns from a request being queued to its grant
+Histogram waitWallHist; // Real ns from a request being queued to its grant
+Histogram blockedHist; // Simulated ns each process spent with a request waiting, recorded when it exits or is killed
+Histogram spawnWallHist; // Real ns to set each new worker going, from taking its slot to starting it
+
+bool incremental = false; // Detect deadlock when a process blocks instead of every second
+vector<int> partialWaiters; // Blocked processes given part of their request since the last check, which may have formed a deadlock
+int* seen; // Epoch a process was last reached by incremental detection
+int seenEpoch = 0; // Incremented by every incremental detection run so seen never needs clearing
+
+bool avoid = false; // Banker's algorithm avoidance, requests are only granted if the system stays in a safe state
+int unsafeWaits = 0; // Amount of requests that could have been granted but were made to wait because granting was unsafe
 
 void print_usage(const char * app)
 {
-	fprintf(stdout, "usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f]\n", app);
+	fprintf(stdout, "usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f] [-e] [-r] [-w] [-d] [-g] [-k cost] [-b] [-m resources] [-u instances] [-x burst] [-a ops] [-t threads] [-l] [-o trace] [-p] [-c config]\n", app);
 	fprintf(stdout, "      proc is the number of total children to launch\n");
 	fprintf(stdout, "      simul indicates how many children are to be allowed to run simultaneously\n");
 	fprintf(stdout, "      itnterval is the time between launching children\n");
 	fprintf(stdout, "      selecting f will output to a logfile as well\n");
+	fprintf(stdout, "      selecting e will make oss sleep until a message, child exit, or its next spawn, print, detection, or worker wake up with w instead\n");
+	fprintf(stdout, "      of polling, then move the clock on by the time slept. Workers without w and tasks watch the clock, so it still ticks every 1 ms\n");
+	fprintf(stdout, "      selecting r will pass messages through a shared memory ring instead of the message queue\n");
+	fprintf(stdout, "      selecting w will make workers sleep until their next act time instead of spinning on the clock\n");
+	fprintf(stdout, "      selecting d will run as a discrete event simulation, jumping the clock to the next event with no real time limit\n");
+	fprintf(stdout, "      selecting g will detect deadlock from the wait-for graph whenever a process blocks instead of every second\n");
+	fprintf(stdout, "      cost picks deadlock victims by fewest resources held (held), least run time (runtime), or most waiters unblocked (waiters)\n");
+	fprintf(stdout, "      selecting b will avoid deadlock with the banker's algorithm, only granting requests that leave the system safe\n");
+	fprintf(stdout, "      resources is the number of resource types, and instances the number of each\n");
+	fprintf(stdout, "      burst is the most instances a worker asks for in one request, spread over up to %d resource types\n", MSG_UNITS);
+	fprintf(stdout, "      ops is the most requests and releases each worker keeps in flight, up to %d, and cannot be above 1 with d\n", MAILBOX_SIZE);
+	fprintf(stdout, "      threads runs workers as tasks on that many threads inside oss instead of forking a process for each, for runs with thousands\n");
+	fprintf(stdout, "      selecting l will pre-launch a pool of workers and start each new worker in an idle one instead of launching a process\n");
+	fprintf(stdout, "      trace is a file to record every event to in binary, read with osstrace\n");
+	fprintf(stdout, "      selecting p will only print the table rows that changed since the last print\n");
+	fprintf(stdout, "      config is a file of \"proc N\", \"simul N\", \"resources N\", and \"instances N...\" lines, one instance count per type\n");
 }
 
-// Function to increment system clock in seconds and nanoseconds
-void incrementClock()
+// Function to move worker deadlines registered since the last call into the heap
+void collectWaiters()
+{
+	atomic<uint64_t>* pending = clockPending(shm_ptr);
+	for (int w = 0; w < maskWords(nProc); w++)
+	{
+		if (pending[w].load(memory_order_relaxed) == 0)
+			continue;
+		uint64_t bits = pending[w].exchange(0);
+		while (bits != 0)
+		{
+			int slot = w * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			deadlines.push({clockWaiter(shm_ptr, slot)->deadline.load(memory_order_relaxed), slot, 0, 0});
+		}
+	}
+}
+
+// Function to collect newly registered worker deadlines and wake every worker whose deadline the clock has passed
+void wakeWaiters(uint64_t now)
 {
-	// Update nanoseconds and check for overflow
-	shm_ptr[1] += 10000000;
-	if (shm_ptr[1] >= 1000000000) // Determines if nanosec is gt 1 billion, meaning it should convert to 1 second
+	collectWaiters();
+
+	// Wake workers from earliest deadline until reaching one still in the future
+	while (!deadlines.empty() && deadlines.top().at <= now)
 	{
-		shm_ptr[1] -= 1000000000;
-		shm_ptr[0]++;
+		clockWake(shm_ptr, deadlines.top().slot);
+		deadlines.pop();
 	}
+}
 
+// Function to increment system clock by 10 ms
+void incrementClock()
+{
+	uint64_t now = clockAdvance(shm_ptr, CLOCK_STEP_NS);
+	if (clockWaits)
+		wakeWaiters(now);
 }
 
 // Function to add a small overhead of 1000 ns to the clock (less amount than incrmenting clock)
 void addOverhead()
 {
-	// Increment ns in shared memor
-	shm_ptr[1] += 1000;
-	// Check for overflow
-	if (shm_ptr[1] >= 1000000000)
-	{
-		shm_ptr[1] -= 1000000000;
-		shm_ptr[0]++;
-	}
+	uint64_t now = clockAdvance(shm_ptr, 1000);
+	if (clockWaits)
+		wakeWaiters(now);
 }
 
 // Function to access and add to shared memory
@@ -143,8 +295,8 @@ void shareMem()
 	// Generate key
 	const int sh_key = ftok("main.c", 0);
 	// Create shared memory
-	shm_id = shmget(sh_key, sizeof(int) * 2, IPC_CREAT | 0666);
-	if (shm_id <= 0) // Check if shared memory get failed
+	shm_id = shmget(sh_key, clockSize(nProc), IPC_CREAT | 0666);
+	if (shm_id < 0) // Check if shared memory get failed
 	{
 		// If true, print error message and exit
 		fprintf(stderr, "Shared memory get failed\n");
@@ -152,345 +304,1574 @@ void shareMem()
 	}
 	
 	// Attach shared memory
-	shm_ptr = (int*)shmat(shm_id, 0, 0);
-	if (shm_ptr <= 0)
+	shm_ptr = (SimClock*)shmat(shm_id, 0, 0);
+	if (shm_ptr == (SimClock*)-1)
 	{
 		fprintf(stderr, "Shared memory attach failed\n");
 		exit(1);
 	}
-	// Initialize shared memory pointers to represent clock
-	// Index 0 represents seconds, index 1 represents nanoseconds
-	shm_ptr[0] = 0;
-	shm_ptr[1] = 0;
+	// Initialize clock to 0 ns with a wait registration per slot and no worker waiting on it
+	shm_ptr->nWaiters = nProc;
+	shm_ptr->ossAsleep.store(0);
+	shm_ptr->ns.store(0);
+	for (int w = 0; w < maskWords(nProc); w++)
+		clockPending(shm_ptr)[w].store(0);
+	for (int i = 0; i < nProc; i++)
+	{
+		clockWaiter(shm_ptr, i)->deadline.store(0);
+		clockWaiter(shm_ptr, i)->wake.store(0);
+	}
+}
+
+// Function to create and attach the shared memory transport used in place of the message queue. Tasks share oss's memory, so theirs is
+// kept on the heap instead of in a segment
+void setupRing()
+{
+	if (tasks)
+	{
+		if (posix_memalign((void**)&ring, CACHE_LINE, transportSize(nProc, maxOps)) != 0)
+		{
+			fprintf(stderr, "Transport allocation failed\n");
+			exit(1);
+		}
+		transportInit(ring, nProc, maxOps);
+		return;
+	}
+
+	// Generate key from same file as message queue, with a different id
+	const int ring_key = ftok("msgq.txt", 2);
+	ring_id = shmget(ring_key, transportSize(nProc, maxOps), IPC_CREAT | 0666);
+	if (ring_id < 0)
+	{
+		fprintf(stderr, "Transport shared memory get failed\n");
+		exit(1);
+	}
+
+	ring = (Transport*)shmat(ring_id, 0, 0);
+	if (ring == (Transport*)-1)
+	{
+		fprintf(stderr, "Transport shared memory attach failed\n");
+		exit(1);
+	}
+	transportInit(ring, nProc, maxOps);
+}
+
+// Function to detach and remove the shared memory transport
+void removeRing()
+{
+	if (tasks)
+	{
+		free(ring);
+		return;
+	}
+	if (shmdt(ring) == -1)
+	{
+		perror("shmdt transport failed");
+		exit(1);
+	}
+	if (shmctl(ring_id, IPC_RMID, NULL) == -1)
+	{
+		perror("shmctl transport failed");
+		exit(1);
+	}
+}
+
+// Function to set up the live statistics segment, sized for the resource table. Keyed on the same file as the message queue so
+// ossstat can find it from the same directory
+void setupStats()
+{
+	const int stats_key = ftok("msgq.txt", STATS_KEY_ID);
+	stats_id = shmget(stats_key, statsSize(nRes), IPC_CREAT | 0666);
+	if (stats_id < 0)
+	{
+		fprintf(stderr, "Statistics shared memory get failed\n");
+		exit(1);
+	}
+
+	stats = (Stats*)shmat(stats_id, 0, 0);
+	if (stats == (Stats*)-1)
+	{
+		fprintf(stderr, "Statistics shared memory attach failed\n");
+		exit(1);
+	}
+	memset((void*)stats, 0, statsSize(nRes));
+	stats->version = STATS_VERSION;
+	stats->nRes = nRes;
+	stats->ossPid = getpid();
+}
+
+// Function to copy the counters and each resource's available instances and wait queue length into the live statistics segment.
+// launched is the amount of workers launched so far
+void publishStats(int launched)
+{
+	statsBegin(stats);
+	int64_t values[STAT_COUNTERS] = {(int64_t)clockNow(shm_ptr), running, launched, immGrant, waitGrant, regTerms, dlRuns, dlKills, totDlProcs, unsafeWaits};
+	for (int i = 0; i < STAT_COUNTERS; i++)
+		stats->counters[i].store(values[i], memory_order_relaxed);
+	for (int r = 0; r < nRes; r++)
+	{
+		statsRes(stats, r)->available.store(resTable[r].available, memory_order_relaxed);
+		statsRes(stats, r)->waitLen.store(resTable[r].waitLen, memory_order_relaxed);
+	}
+	statsEnd(stats);
+}
+
+// Function to publish the counters one last time, mark the run done so readers stop, and remove the live statistics segment
+void removeStats(int launched)
+{
+	publishStats(launched);
+	stats->done.store(1, memory_order_release);
+	if (shmdt(stats) == -1)
+	{
+		perror("shmdt statistics failed");
+		exit(1);
+	}
+	if (shmctl(stats_id, IPC_RMID, NULL) == -1)
+	{
+		perror("shmctl statistics failed");
+		exit(1);
+	}
+}
+
+// Functions to write a string or number at p and return the end, used to render the tables without a printf call per cell
+char* appendStr(char* p, const char* str)
+{
+	while (*str != '\0')
+		*p++ = *str++;
+	return p;
 }
 
-// FUnction to print formatted process table and resource table to console. Will also print to logfile if necessary.
+char* appendUint(char* p, uint32_t v)
+{
+	char digits[10];
+	int n = 0;
+	do
+	{
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+	while (n > 0)
+		*p++ = digits[--n];
+	return p;
+}
+
+char* appendInt(char* p, int v)
+{
+	if (v < 0)
+	{
+		*p++ = '-';
+		return appendUint(p, -(uint32_t)v);
+	}
+	return appendUint(p, v);
+}
+
+// Function to get the bytes printInfo can render, with room for every slot, so it never has to check for room while rendering. A
+// process table row is at most 5 numbers and 6 tabs and a resource table row is a number and a tab per resource after its label
+size_t snapBytes(int n, int m)
+{
+	return 256 + (size_t)m * 16 + (size_t)n * (64 + 16 + (size_t)m * 12);
+}
+
+// FUnction to print formatted process table and resource table to console, and to logfile if one is open. Both tables are rendered
+// in one pass over the slots into snapBuf, with the resource table rows going to snapRows and being copied after the process table,
+// then go to the logger in one write. In delta mode only slots whose process or held resources changed since the last print are
+// listed, with a slot that was emptied shown as unoccupied in the process table
 void printInfo(int n)
 {
+	if (LOG_LEVEL < LOG_INFO)
+		return;
 
-	// Print process control block 	
-	printf("OSS PID: %d SysClockS: %u SysClockNano: %u\n Process Table:\n", getpid(), shm_ptr[0], shm_ptr[1]);
-	printf("Entry\tOccupied\tPID\tStartS\tStartNs\n");
-	
-	if(logging) fprintf(logfile, "OSS PID: %d SysClockS: %u SysClockNano: %u\n Process Table:\n", getpid(), shm_ptr[0], shm_ptr[1]);
-	if (logging) fprintf(logfile,"Entry\tOccupied\tPID\tStartS\tStartNs\n");
+	uint64_t now = clockNow(shm_ptr);
+	char* p = snapBuf;
+	char* rows = snapRows;
+
+	// Print process control block
+	p += sprintf(p, "OSS PID: %d SysClockS: %u SysClockNano: %u\n Process Table%s:\n", getpid(), clockSec(now), clockNano(now), deltaPrint ? " (changed since last print)" : "");
+	p = appendStr(p, "Entry\tOccupied\tPID\tStartS\tStartNs\n");
 
 	for (int i = 0; i < n; i++)
 	{
+		PCB* pcb = &processTable[i];
+		pid_t pid = pcb->occupied ? pcb->pid : 0;
+		if (deltaPrint)
+		{
+			// Skip slot if it holds the same process with the same resources as last print
+			int* last = &lastHeldMat[(size_t)i * nRes];
+			if (pid == lastPid[i] && (pid == 0 || memcmp(last, pcb->held, nRes * sizeof(int)) == 0))
+				continue;
+			lastPid[i] = pid;
+			if (pid != 0)
+				memcpy(last, pcb->held, nRes * sizeof(int));
+			else // Slot was emptied since last print
+			{
+				p = appendInt(p, i);
+				p = appendStr(p, "\t0\n");
+				continue;
+			}
+		}
 		// Print table only if occupied by process
-		if (processTable[i].occupied == 1)
+		else if (pid == 0)
+			continue;
+
+		p = appendInt(p, i);
+		p = appendStr(p, "\t1\t\t");
+		p = appendInt(p, pcb->pid);
+		*p++ = '\t';
+		p = appendUint(p, pcb->startSeconds);
+		*p++ = '\t';
+		p = appendUint(p, pcb->startNano);
+		*p++ = '\n';
+
+		// Print resources held by process
+		*rows++ = 'P';
+		rows = appendInt(rows, i);
+		*rows++ = '\t';
+		for (int j = 0; j < nRes; j++)
 		{
-			printf("%d\t%d\t\t%d\t%u\t%u\n", i, processTable[i].occupied, processTable[i].pid, processTable[i].startSeconds, processTable[i].startNano);
-			if (logging) fprintf(logfile, "%d\t%d\t\t%d\t%u\t%u\n", i, processTable[i].occupied, processTable[i].pid, processTable[i].startSeconds, processTable[i].startNano);
+			rows = appendInt(rows, pcb->held[j]);
+			*rows++ = '\t';
 		}
+		*rows++ = '\n';
 	}
-	printf("\n");
-	if (logging) fprintf(logfile, "\n");
+	*p++ = '\n';
 
 	// Print resource table
-	printf("Current system resources\n");
-	if (logging) fprintf(logfile, "Current system resources\n");
+	p = appendStr(p, "Current system resources\n\t");
+	for (int i = 0; i < nRes; i++)
+	{
+		*p++ = 'R';
+		p = appendInt(p, i);
+		*p++ = '\t';
+	}
+	*p++ = '\n';
+	memcpy(p, snapRows, rows - snapRows);
+	p += rows - snapRows;
+	*p++ = '\n';
 
-	printf("\t");
-	if (logging) fprintf(logfile, "\t");
-	for (int i = 0; i < MAX_RES; i++)
+	logWrite(snapBuf, p - snapBuf);
+}
+
+// Signal handler to record that 3 seconds of real time have passed. The main loop then stops, terminates every process still running,
+// stops the task threads, and prints the final statistics, since logging, exiting, and joining threads are not safe to do in a handler
+void signal_handler(int sig)
+{
+	timeUp = 1;
+	// A futex wait is restarted after a handler returns, so wake oss directly when it is sleeping on the ring
+	if (ring != NULL)
+		ringNotify(ring);
+}
+
+// Function to send buf to the worker in process table slot indx. Posts to the slot's mailbox when using the shared memory
+// transport, otherwise sends on the message queue, retrying if the send was interrupted by a signal
+void sendMsg(int indx, const char* what)
+{
+	buf.mtype = processTable[indx].pid; // Represents worker's pid
+	// In discrete event mode, receiving worker is running again until its next message
+	if (des)
+		active++;
+	if (ring != NULL)
+	{
+		mailboxPost(transportMailbox(ring, indx), &buf);
+		return;
+	}
+	while (msgsnd(msqid, &buf, sizeof(msgbuffer) - sizeof(long), 0) == -1)
 	{
-		printf("R%d\t", i);
-		if (logging) fprintf(logfile, "R%d\t", i);
+		if (errno == EINTR)
+			continue;
+		perror(what);
+		exit(1);
 	}
-	printf("\n");
-	if (logging) fprintf(logfile, "\n");
+}
 
-	for (int i = 0; i < n; i++)
+// Function to launch a worker process in process table slot indx, or idle in the pool if indx is -1, and return its pid. Uses
+// posix_spawn, which does not copy oss's memory to run the worker the way fork and exec would
+pid_t launchWorker(int indx)
+{
+	// Create array of arguments to pass to exec. "./worker" is the program to execute, followed by the worker's slot and the arguments
+	// every worker is given, and NULL shows it is the end of the argument list
+	char slotArg[16];
+	snprintf(slotArg, sizeof(slotArg), "%d", indx);
+	vector<char*> args;
+	args.push_back((char*)"./worker");
+	args.push_back((char*)"-s");
+	args.push_back(slotArg);
+	for (size_t i = 0; i < workerArgs.size(); i++)
+		args.push_back((char*)workerArgs[i].c_str());
+	args.push_back(NULL);
+
+	pid_t pid;
+	int err = posix_spawn(&pid, args[0], NULL, NULL, args.data(), environ);
+	if (err != 0)
 	{
-		// Print resources held by process only if process is occupied in PCB
-		if (processTable[i].occupied)
+		// If this prints, the worker could not be launched
+		fprintf(stderr, "Exec failed, terminating! %s\n", strerror(err));
+		exit(1);
+	}
+	return pid;
+}
+
+// Function to start a new lifetime in idle pooled worker pid, running in process table slot indx. Sent on the message queue whichever
+// transport is in use, since an idle worker reads no slot's mailbox
+void startWorker(int indx, pid_t pid)
+{
+	msgbuffer start;
+	start.mtype = pid;
+	start.pid = pid;
+	start.kind = MSG_START;
+	start.seq = indx;
+	start.nUnits = 0;
+	while (msgsnd(msqid, &start, sizeof(msgbuffer) - sizeof(long), 0) == -1)
+	{
+		if (errno == EINTR)
+			continue;
+		perror("msgsnd start");
+		exit(1);
+	}
+}
+
+// Function to receive the next message from a worker into rcvbuf. If block is true, waits until a message arrives, a signal
+// interrupts the wait, or the sleep armed by armSleep is up. Returns true if a message was received
+bool recvMsg(bool block)
+{
+	while (true)
+	{
+		if (ring != NULL)
 		{
-			printf("P%d\t", i);
-			if (logging) fprintf(logfile, "P%d\t", i);
-			for (int j = 0; j < MAX_RES; j++)
+			if (!ringPop(ring, &rcvbuf))
 			{
-				printf("%d\t", processTable[i].held[j]);
-				if (logging) fprintf(logfile, "%d\t", processTable[i].held[j]);
+				if (!block)
+					return false;
+				// Sleep until a worker pushes a message, a child exits, or the sleep is up
+				struct timespec timeout = {(time_t)(sleepNs / NS_PER_SEC), (long)(sleepNs % NS_PER_SEC)};
+				ringWait(ring, &timeout);
+				if (!ringPop(ring, &rcvbuf))
+					return false;
 			}
-			printf("\n");
-			if (logging) fprintf(logfile, "\n");
 		}
+		else if (msgrcv(msqid, &rcvbuf, sizeof(msgbuffer) - sizeof(long), 1, block ? 0 : IPC_NOWAIT) == -1)
+		{
+			// No message waiting, or woken by child exit or the sleep's timer
+			if (errno == ENOMSG || errno == EINTR)
+				return false;
+			perror("msgrcv");
+			exit(1);
+		}
+
+		// A wake up from a worker ends the sleep and has nothing to handle. One left over from an earlier sleep is passed over
+		if (rcvbuf.kind != MSG_WAKE)
+			return true;
+		if (block)
+			return false;
 	}
-	printf("\n");
-	if (logging) fprintf(logfile, "\n");
-	
 }
 
-// Signal handler to terminate all processes after 3 seconds in real time
-void signal_handler(int sig)
+// Signal handler to record that a child has exited. Also interrupts a blocking msgrcv
+void child_handler(int sig)
+{
+	childExited = 1;
+	// A futex wait is restarted after a handler returns, so wake oss directly when it is sleeping on the ring
+	if (ring != NULL)
+		ringNotify(ring);
+}
+
+// Signal handler for the event mode sleep timer. Only used to interrupt a blocking msgrcv
+void tick_handler(int sig)
+{
+}
+
+// Function to set up event mode. Installs handlers for child exit and the timer that ends a sleep on the message queue, so a blocking
+// msgrcv wakes for either one. System V message calls are never restarted, so msgrcv returns EINTR even with SA_RESTART set
+void setupEventMode()
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+
+	sa.sa_handler = child_handler;
+	sigaction(SIGCHLD, &sa, NULL);
+	sa.sa_handler = tick_handler;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	// Create timer that sends SIGUSR1 when a sleep is up, armed by armSleep. A sleep on the ring times out by itself
+	if (ring != NULL)
+		return;
+	struct sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGUSR1;
+	if (timer_create(CLOCK_MONOTONIC, &sev, &wakeTimer) == -1)
+	{
+		perror("timer_create");
+		exit(1);
+	}
+}
+
+// Function to set how long the next event mode sleep lasts and return how many clock steps it stands for. With w, workers only need the
+// clock to reach their deadlines, so oss sleeps through every step until next, the earliest of the next spawn, print, and detection,
+// or until the earliest worker deadline if that is sooner. Workers without w and tasks watch the clock, so the sleep is one step.
+// The clock does not step in discrete event mode, so the sleep lasts until a message or child exit and stands for no steps
+uint64_t armSleep(uint64_t now, uint64_t next)
+{
+	uint64_t steps = 1;
+	if (des)
+		steps = 0;
+	else if (clockWaits)
+	{
+		// Announce the sleep before collecting deadlines, so a worker that registers one after this sends a wake up
+		shm_ptr->ossAsleep.store(1, memory_order_seq_cst);
+		atomic_thread_fence(memory_order_seq_cst);
+		collectWaiters();
+		if (!deadlines.empty() && deadlines.top().at < next)
+			next = deadlines.top().at;
+		if (next > now)
+			steps = (next - now + CLOCK_STEP_NS - 1) / CLOCK_STEP_NS;
+	}
+	// With no steps there is still a limit, in case a child exit signal lands after oss checked for one but before it sleeps
+	sleepNs = steps > 0 ? steps * EVENT_TICK_NS : EVENT_IDLE_NS;
+
+	// A sleep on the message queue is ended by the timer's signal. It repeats in case the signal lands just before msgrcv starts
+	if (ring == NULL)
+	{
+		struct itimerspec its;
+		its.it_value.tv_sec = sleepNs / NS_PER_SEC;
+		its.it_value.tv_nsec = sleepNs % NS_PER_SEC;
+		its.it_interval = its.it_value;
+		if (timer_settime(wakeTimer, 0, &its, NULL) == -1)
+		{
+			perror("timer_settime");
+			exit(1);
+		}
+	}
+	return steps;
+}
+
+// Function to move the clock on after an event mode sleep of steps clock steps that lasted slept ns of real time. Adds every step
+// that passed in real time except the one this pass of the main loop adds, as if the clock had ticked through them, but never
+// moves past the deadline the sleep was armed for
+void endSleep(uint64_t steps, uint64_t slept)
+{
+	if (clockWaits)
+		shm_ptr->ossAsleep.store(0, memory_order_relaxed);
+	uint64_t passed = slept / EVENT_TICK_NS;
+	if (passed > steps)
+		passed = steps;
+	if (passed > 1)
+		clockAdvance(shm_ptr, (passed - 1) * CLOCK_STEP_NS);
+}
+
+// Function to reply to every worker in discrete event mode whose sleep message, or request or release with a reply held back, asked
+// for a time the clock has reached
+void wakeSleepers(uint64_t now)
+{
+	while (!deadlines.empty() && deadlines.top().at <= now)
+	{
+		Deadline d = deadlines.top();
+		deadlines.pop();
+		// Skip deadlines left behind by a worker that was killed
+		if (!processTable[d.slot].occupied || processTable[d.slot].pid != d.pid)
+			continue;
+		buf.granted = true;
+		buf.seq = d.seq;
+		sendMsg(d.slot, "msgsnd sleep wakeup");
+	}
+}
+
+// Function to send the reply in buf to the message in rcvbuf from process indx. In discrete event mode a worker can ask for the reply
+// to be held until the time it next has something to do, so it needs no sleep message of its own
+void replyAt(int indx, const char* what)
+{
+	if (des && rcvbuf.wakeAt > clockNow(shm_ptr))
+		deadlines.push({rcvbuf.wakeAt, indx, processTable[indx].pid, buf.seq});
+	else
+		sendMsg(indx, what);
+}
+
+// Function to move the clock straight to the next event in discrete event mode: earliest worker wake up, next spawn, next table
+// print, or next deadlock check. Only called when no worker is running, so nothing can happen before then
+void jumpClock(uint64_t nextSpawn, uint64_t nextPrint, uint64_t nextChk)
+{
+	uint64_t next = nextPrint < nextChk ? nextPrint : nextChk;
+	if (nextSpawn < next)
+		next = nextSpawn;
+	if (!deadlines.empty() && deadlines.top().at < next)
+		next = deadlines.top().at;
+
+	uint64_t now = clockNow(shm_ptr);
+	if (next > now)
+		clockAdvance(shm_ptr, next - now);
+	wakeSleepers(clockNow(shm_ptr));
+}
+
+// Function to get the real time in ns, for latencies measured in wall clock time
+uint64_t wallNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+// Function to add the instances of resource r held since its last change to its busy time, before available changes
+void trackUsage(int r)
+{
+	uint64_t now = clockNow(shm_ptr);
+	Resource* res = &resTable[r];
+	res->busyArea += (now - res->lastChange) * (res->total - res->available);
+	res->lastChange = now;
+}
+
+// Function to move cnt instances of resource r from available to process p, keeping the resource's holder list up to date
+void allocate(int p, int r, int cnt)
+{
+	if (resTable[r].allocation[p] == 0)
+	{
+		resTable[r].holderPos[p] = resTable[r].nHolders;
+		resTable[r].holders[resTable[r].nHolders++] = p;
+	}
+	trackUsage(r);
+	resTable[r].available -= cnt;
+	resTable[r].maxInUse = max(resTable[r].maxInUse, resTable[r].total - resTable[r].available);
+	resTable[r].allocation[p] += cnt;
+	processTable[p].held[r] += cnt;
+	if (avoid)
+		resTable[r].need[p] -= cnt;
+}
+
+// Function to return cnt instances of resource r from process p to available, keeping the resource's holder list up to date
+void deallocate(int p, int r, int cnt)
+{
+	trackUsage(r);
+	resTable[r].available += cnt;
+	resTable[r].allocation[p] -= cnt;
+	processTable[p].held[r] -= cnt;
+	if (avoid)
+		resTable[r].need[p] += cnt;
+	if (resTable[r].allocation[p] == 0 && resTable[r].holderPos[p] >= 0)
+	{
+		// Fill p's spot in holders with the last holder
+		int pos = resTable[r].holderPos[p];
+		int last = resTable[r].holders[--resTable[r].nHolders];
+		resTable[r].holders[pos] = last;
+		resTable[r].holderPos[last] = pos;
+		resTable[r].holderPos[p] = -1;
+	}
+}
+
+// Function to add process p to the end of resource r's wait queue
+void waitPush(int r, int p)
+{
+	Resource* res = &resTable[r];
+	res->waitNext[p] = -1;
+	res->waitPrev[p] = res->waitTail;
+	if (res->waitTail >= 0)
+		res->waitNext[res->waitTail] = p;
+	else
+		res->waitHead = p;
+	res->waitTail = p;
+	res->waitLen++;
+	res->maxWaitLen = max(res->maxWaitLen, res->waitLen);
+}
+
+// Function to take process p out of resource r's wait queue, from anywhere in it. Does nothing if p is not waiting for r
+void waitRemove(int r, int p)
+{
+	Resource* res = &resTable[r];
+	if (res->waitPrev[p] == NOT_WAITING)
+		return;
+	int prev = res->waitPrev[p];
+	int next = res->waitNext[p];
+	// Link neighbors to each other, or move head or tail if p was at an end
+	if (prev >= 0)
+		res->waitNext[prev] = next;
+	else
+		res->waitHead = next;
+	if (next >= 0)
+		res->waitPrev[next] = prev;
+	else
+		res->waitTail = prev;
+	res->waitPrev[p] = NOT_WAITING;
+	res->waitLen--;
+}
+
+// Function to find if process p is blocked: every request it may have in flight is waiting, so it cannot act, and so cannot release
+// anything, until one of them is granted. A process with fewer requests waiting can still act
+bool blocked(int p)
+{
+	return processTable[p].nPending == maxOps;
+}
+
+// Function to get a view of the tables for detection and recovery, measuring processes against their outstanding requests, or their
+// remaining claims when useNeed is set. Available instances and which slots are in use are copied out of the tables, since those live
+// in the table entries rather than in rows of their own. With more than one request in flight, a process that is not blocked can still
+// act, so it gets nothing to wait for, and a blocked one gets each pending request as a demand of its own, since it goes on once any
+// one is granted. With one, outstanding requests are already that
+TableView tableView(bool useNeed)
+{
+	static int* available = new int[nRes];
+	static bool* live = new bool[nProc];
+	for (int i = 0; i < nRes; i++)
+		available[i] = resTable[i].available;
+	for (int p = 0; p < nProc; p++)
+		live[p] = processTable[p].occupied;
+	if (useNeed || maxOps == 1)
+		return {nRes, nProc, matrixStride(nProc), available, allocMat, useNeed ? needMat : reqMat, live, 1, matrixStride(nProc)};
+
+	int stride = matrixStride(nProc * maxOps);
+	memset(waitMat, 0, (size_t)nRes * stride * sizeof(int));
+	for (int p = 0; p < nProc; p++)
+	{
+		for (int o = 0; live[p] && blocked(p) && o < maxOps; o++)
+		{
+			const PendingOp* op = &processTable[p].ops[o];
+			for (int u = 0; u < op->nUnits; u++)
+				waitMat[(size_t)op->units[u].resId * stride + p * maxOps + o] = op->units[u].count;
+		}
+	}
+	return {nRes, nProc, matrixStride(nProc), available, allocMat, waitMat, live, maxOps, stride};
+}
+
+// Function to detect if system is deadlocked, leaving the deadlocked processes in lastDl and the count in dlCnt
+bool deadlock()
+{
+	dlCnt = findDeadlocked(tableView(false), lastDl);
+	return dlCnt > 0;
+}
+
+// Function to determine if granting process p the rest of pending request op leaves the system in a safe state, meaning every
+// process could still get the rest of its claim in some order. Tries the grant on the tables, runs the safety check, and puts them back
+bool safeToGrant(int p, const PendingOp* op)
+{
+	for (int i = 0; i < op->nUnits; i++)
+	{
+		Resource* res = &resTable[op->units[i].resId];
+		int cnt = op->units[i].count;
+		res->available -= cnt;
+		res->allocation[p] += cnt;
+		res->need[p] -= cnt;
+	}
+
+	static bool* finish = new bool[nProc]; // Sized once, since the process table does not change size after startup
+	findFinishable(tableView(true), finish);
+
+	for (int i = 0; i < op->nUnits; i++)
+	{
+		Resource* res = &resTable[op->units[i].resId];
+		int cnt = op->units[i].count;
+		res->available += cnt;
+		res->allocation[p] -= cnt;
+		res->need[p] += cnt;
+	}
+
+	for (int i = 0; i < nProc; i++)
+		if (!finish[i])
+			return false;
+	return true;
+}
+
+// Function to find the first resource request op has more of left than is available, -1 if the rest of it fits now
+int opShort(const PendingOp* op)
+{
+	for (int i = 0; i < op->nUnits; i++)
+		if (op->units[i].count > resTable[op->units[i].resId].available)
+			return op->units[i].resId;
+	return -1;
+}
+
+// Function to find if every instance of request op has been granted
+bool opDone(const PendingOp* op)
+{
+	for (int i = 0; i < op->nUnits; i++)
+		if (op->units[i].count > 0)
+			return false;
+	return true;
+}
+
+// Function to grant as much of process p's pending request op as its mode allows, moving it from request to allocation in one step.
+// An all-or-nothing request is granted only once every instance fits, and in avoidance mode only if the result is safe. A partial
+// request takes whatever is available of each resource now. Avoidance mode only checks safety for whole requests, so it grants
+// partial requests all at once too. Returns the amount of instances granted
+int grantOp(int p, PendingOp* op)
+{
+	bool whole = opShort(op) < 0 && (!avoid || safeToGrant(p, op));
+	int granted = 0;
+	for (int i = 0; i < op->nUnits; i++)
+	{
+		int r = op->units[i].resId;
+		int cnt = 0;
+		if (whole)
+			cnt = op->units[i].count;
+		else if (op->partial && !avoid)
+			cnt = min(op->units[i].count, resTable[r].available);
+		if (cnt > 0)
+		{
+			allocate(p, r, cnt);
+			resTable[r].request[p] -= cnt;
+			op->units[i].count -= cnt;
+			granted += cnt;
+		}
+	}
+	return granted;
+}
+
+// Function to remove pending request i of process p, keeping the rest in the order they arrived
+void removeOp(int p, int i)
+{
+	PCB* pcb = &processTable[p];
+	for (int j = i + 1; j < pcb->nPending; j++)
+		pcb->ops[j - 1] = pcb->ops[j];
+	pcb->nPending--;
+}
+
+// Function to put process p in the wait queue of each resource one of its pending requests waits for, and take it out of the rest.
+// A request waits for the first resource it is short of, or if it is only waiting because granting would be unsafe, the first
+// resource it still asks for. A process with several requests in flight can wait on several resources at once
+void syncQueues(int p)
+{
+	static bool* want = new bool[nRes]; // Resources p should be queued on
+	for (int r = 0; r < nRes; r++)
+		want[r] = false;
+	for (int i = 0; i < processTable[p].nPending; i++)
+	{
+		const PendingOp* op = &processTable[p].ops[i];
+		int r = opShort(op);
+		for (int u = 0; r < 0 && u < op->nUnits; u++)
+			if (op->units[u].count > 0)
+				r = op->units[u].resId;
+		want[r] = true;
+	}
+
+	for (int r = 0; r < nRes; r++)
+	{
+		if (!want[r])
+			waitRemove(r, p);
+		else if (resTable[r].waitPrev[p] == NOT_WAITING)
+			waitPush(r, p);
+	}
+}
+
+// Function to try to finish the pending requests of waiting process p, oldest first. Sends a grant for each request that is now
+// fully granted, then moves p to the queues of what it still waits for. Returns true if any request was finished
+bool serveWaiter(int p)
+{
+	bool woke = false;
+	int granted = 0;
+	for (int i = 0; i < processTable[p].nPending; i++)
+	{
+		PendingOp* op = &processTable[p].ops[i];
+		granted += grantOp(p, op);
+		if (!opDone(op))
+			continue;
+
+		// Send message to worker to notify that request is granted
+		buf.granted = true;
+		buf.seq = op->seq;
+		sendMsg(p, "msgsnd wakeup");
+		uint64_t now = clockNow(shm_ptr);
+		traceEvent(now, TRACE_WAKE, p, processTable[p].pid, -1, 0, op->seq);
+		waitGrant++;
+		histRecord(&waitSimHist, now - op->waitSince);
+		histRecord(&waitWallHist, wallNow() - op->waitSinceWall);
+		if (blocked(p))
+			processTable[p].blockedNs += now - processTable[p].blockedSince;
+		woke = true;
+		removeOp(p, i--);
+	}
+	syncQueues(p);
+
+	// Giving instances to a process that stays blocked can leave others stuck without anyone new blocking, so check from p when
+	// detecting incrementally
+	if (incremental && !avoid && granted > 0 && blocked(p))
+		partialWaiters.push_back(p);
+	return woke;
+}
+
+// Function to serve resource r's wait queue in order once instances of it come back. Every waiter is tried, not just the head, since
+// a process short of more than is available would otherwise hold up smaller requests behind it that could run and release
+void serveQueue(int r)
+{
+	int next;
+	for (int p = resTable[r].waitHead; p >= 0 && resTable[r].available > 0; p = next)
+	{
+		next = resTable[r].waitNext[p];
+		serveWaiter(p);
+	}
+}
+
+// Function to grant waiting requests in avoidance mode once resources come back. A process can wait while instances are available
+// because granting was unsafe, so a release of any resource may make any waiting request safe. Every waiter is tried in queue order,
+// not just the head, since a safe state only promises that some process can go on. Loops until nothing changes
+void grantSafeWaiters()
+{
+	bool granted = true;
+	while (granted)
+	{
+		granted = false;
+		for (int r = 0; r < nRes; r++)
+		{
+			// Walk the queue in order, waking each waiter that can be granted
+			int next;
+			for (int n = resTable[r].waitHead; n >= 0 && resTable[r].available > 0; n = next)
+			{
+				next = resTable[r].waitNext[n];
+				if (serveWaiter(n))
+					granted = true;
+			}
+		}
+	}
+}
+
+// Functions giving the cost of killing process p, used by recovery to choose victims. Killing a process that holds fewer instances
+// loses less of its work
+double costHeld(int p)
+{
+	int held = 0;
+	for (int i = 0; i < nRes; i++)
+		held += processTable[p].held[i];
+	return held;
+}
+
+// Killing a process that started more recently throws away less simulated run time
+double costRuntime(int p)
+{
+	uint64_t start = (uint64_t)processTable[p].startSeconds * NS_PER_SEC + processTable[p].startNano;
+	return (double)(clockNow(shm_ptr) - start);
+}
+
+// Killing a process that other processes are waiting on unblocks them, so more waiters means cheaper
+double costWaiters(int p)
+{
+	int waiters = 0;
+	for (int q = 0; q < nProc; q++)
+	{
+		if (q == p || !processTable[q].occupied || !blocked(q))
+			continue;
+		for (int r = 0; r < nRes; r++)
+		{
+			if (resTable[r].request[q] > 0 && resTable[r].allocation[p] > 0)
+			{
+				waiters++;
+				break;
+			}
+		}
+	}
+	return 1.0 / (1 + waiters);
+}
+
+double (*victimCost)(int p) = costHeld; // Cost function recovery uses, chosen with -k
+
+// Function to take back everything process p holds once it is gone, listing what was released, and clear its requests, claims, and
+// place in any wait queue. Waiters are not served here, so the resources of several processes can be returned before one pass
+// hands them out. Resources given back are marked in freed
+void releaseAll(int p)
+{
+	logInfo("   Resources released: ");
+
+	bool first = true; // Represents if first resource has been printed. Used to determine when to print commas.
+
+	// Process's time blocked ends with it
+	if (blocked(p))
+		processTable[p].blockedNs += clockNow(shm_ptr) - processTable[p].blockedSince;
+	histRecord(&blockedHist, processTable[p].blockedNs);
+	processTable[p].nPending = 0;
+	for (int i = 0; i < nRes; i++)
+	{
+		int held = processTable[p].held[i];
+		if (held > 0)
+		{
+			// Print resource, then put it back
+			if (!first)
+			{
+				logInfo(", ");
+			}
+			logInfo("R%d:%d", i, held);
+			first = false;
+			deallocate(p, i, held);
+			traceEvent(clockNow(shm_ptr), TRACE_RELEASE, p, processTable[p].pid, i, held);
+			freed[i] = true;
+		}
+		// Clear any requests and claims from process
+		resTable[i].request[p] = 0;
+		resTable[i].need[p] = 0;
+
+		// Remove process from wait queue so its slot is not granted resources after it is gone
+		waitRemove(i, p);
+	}
+	logInfo("\n");
+}
+
+// Function to hand resources returned by releaseAll to waiting processes in one pass. Only the queues of resources that came back are
+// served. In avoidance mode every waiter is tried, since a process leaving also drops its claim, which may make other requests safe
+void serveFreed()
+{
+	if (avoid)
+		grantSafeWaiters();
+	for (int i = 0; i < nRes; i++)
+	{
+		if (freed[i] && !avoid)
+			serveQueue(i);
+		freed[i] = false;
+	}
+}
+
+// Function to kill a set of deadlocked processes at once, return their resources, and then grant them to processes waiting for them
+void killVictims(const int victims[], int cnt)
+{
+	// Signal every victim before waiting on any, so they all exit together instead of one wait after another
+	for (int v = 0; v < cnt; v++)
+	{
+		logInfo("   Master terminating P%d to remove deadlock\n", victims[v]);
+		traceEvent(clockNow(shm_ptr), TRACE_KILL, victims[v], processTable[victims[v]].pid);
+		if (tasks)
+			taskKill(victims[v]);
+		else
+			kill(processTable[victims[v]].pid, SIGKILL);
+	}
+
+	for (int v = 0; v < cnt; v++)
+	{
+		int victim = victims[v];
+		// Wait for victim to finish. A task is already stopped, between steps
+		while (!tasks && waitpid(processTable[victim].pid, NULL, 0) == -1 && errno == EINTR);
+		// Victim may have been killed in the middle of pushing a message, drop the cell it claimed so oss does not wait on it forever
+		if (ring != NULL && !tasks)
+			ringDropDead(ring, victim);
+		dlKills++;
+
+		logInfo("   Process P%d terminated\n", victim);
+		// Put resources held by victim back into resource and clear victim's requests
+		releaseAll(victim);
+
+		// Mark victim as unoccupied in process table
+		pidMapErase(&pidMap, processTable[victim].pid);
+		processTable[victim].occupied = 0;
+		freeSlots.push_back(victim);
+		// Decrement amount of currently running processes
+		running--;
+	}
+
+	// With every victim's resources returned, grant them to waiting processes in one pass
+	serveFreed();
+}
+
+// Function to take back process table slot indx once its worker, pid, has exited on its own
+void reapWorker(int indx, pid_t pid)
+{
+	pidMapErase(&pidMap, pid);
+
+	// Increment regular terminations
+	regTerms++;
+
+	// Worker exits without releasing what it holds, so take every instance back in one go
+	uint64_t now = clockNow(shm_ptr);
+	logInfo("Master has detected Process P%d terminated at time %u:%09u\n", indx, clockSec(now), clockNano(now));
+	traceEvent(now, TRACE_EXIT, indx, pid);
+	releaseAll(indx);
+	// Mark finished process as unoccupied in process table
+	processTable[indx].occupied = 0;
+	freeSlots.push_back(indx);
+	// Decrement total processes running
+	running--;
+	// In discrete event mode, a worker exits while running, not while waiting on oss
+	if (des)
+		active--;
+}
+
+// Function to recover from deadlock state by killing a set of deadlocked processes that ends it, all at once, as planned by
+// planRecovery: the cheapest set for small deadlocks, otherwise a greedy one with no victim that could be spared
+void recoverDeadlock()
+{
+	vector<int> victims(nProc);
+	int cnt = planRecovery(tableView(false), victimCost, victims.data());
+	if (cnt > 0)
+		killVictims(victims.data(), cnt);
+}
+
+// Function to drop from the candidates in lastDl every process that could be granted all of any one pending request if the processes
+// outside the candidates released what they hold, since those can all still run, then every process that dropping those frees, and so
+// on. Works like the reduction in detect.h instead of rescanning: each pending request of a candidate keeps a count of resources it is
+// short of, each of those resources keeps the requests short of it sorted by how much they ask for, and a dropped candidate hands back
+// what it holds of those resources, meeting requests in order. Cost is bounded by the candidates' pending requests and the holders of
+// the resources they are short of. Candidates are the processes marked seen in this epoch, dropped ones are unmarked
+void dropUnstuck()
+{
+	static int* resEpoch = new int[nRes](); // Call a resource was last found short in, so touched needs no clearing
+	static int* resIdx = new int[nRes]; // Position of each resource in touched
+	static int* unmet = new int[(size_t)nProc * maxOps]; // Amount of touched resources each pending request is short of, by slot*maxOps+op
+	static int* firstHeld = new int[nProc]; // Each candidate's first entry in heldRes, -1 if it holds none of the touched resources
+	static int* ready = new int[nProc]; // Worklist of candidates with a request that is short of nothing
+	static vector<int> touched; // Resources some candidate is short of
+	static vector<int> freeRes; // Instances of each touched resource there would be once every process outside the candidates released
+	static vector<vector<pair<int, int> > > shortOf; // Amount asked and slot*maxOps+op of each request short of each touched resource,
+	                                                  // sorted by amount once filled
+	static vector<int> nextShort; // Next request in shortOf that is not yet met
+	static vector<int> heldRes; // Touched resources each candidate holds, as positions in touched linked through heldNext
+	static vector<int> heldNext;
+	static int epoch = 0;
+	epoch++;
+	touched.clear();
+	heldRes.clear();
+	heldNext.clear();
+	int nReady = 0;
+
+	// Count the resources each pending request of each candidate is short of
+	for (int i = 0; i < dlCnt; i++)
+	{
+		int u = lastDl[i];
+		firstHeld[u] = -1;
+		const PCB* pcb = &processTable[u];
+		bool met = false;
+		for (int o = 0; o < pcb->nPending; o++)
+		{
+			int c = u * maxOps + o;
+			unmet[c] = 0;
+			for (int k = 0; k < pcb->ops[o].nUnits; k++)
+			{
+				int r = pcb->ops[o].units[k].resId;
+				int cnt = pcb->ops[o].units[k].count;
+				if (cnt <= resTable[r].available)
+					continue;
+				if (resEpoch[r] != epoch)
+				{
+					resEpoch[r] = epoch;
+					resIdx[r] = touched.size();
+					touched.push_back(r);
+					if (shortOf.size() < touched.size())
+						shortOf.resize(touched.size());
+					shortOf[resIdx[r]].clear();
+				}
+				shortOf[resIdx[r]].push_back({cnt, c});
+				unmet[c]++;
+			}
+			met = met || unmet[c] == 0;
+		}
+		if (met)
+		{
+			seen[u] = 0;
+			ready[nReady++] = u;
+		}
+	}
+
+	// Meet every request for touched resource t that now fits in what it would have free. A candidate is dropped as soon as one of its
+	// requests is met
+	freeRes.resize(touched.size());
+	nextShort.assign(touched.size(), 0);
+	auto meet = [&](int t)
+	{
+		const vector<pair<int, int> >& row = shortOf[t];
+		while (nextShort[t] < (int)row.size() && row[nextShort[t]].first <= freeRes[t])
+		{
+			int c = row[nextShort[t]++].second;
+			int q = c / maxOps;
+			if (--unmet[c] == 0 && seen[q] == seenEpoch)
+			{
+				seen[q] = 0;
+				ready[nReady++] = q;
+			}
+		}
+	};
+
+	// Add up what each touched resource would have free, linking each holder that is a candidate to it instead
+	for (int t = 0; t < (int)touched.size(); t++)
+	{
+		Resource* res = &resTable[touched[t]];
+		freeRes[t] = res->available;
+		for (int h = 0; h < res->nHolders; h++)
+		{
+			int q = res->holders[h];
+			if (seen[q] != seenEpoch) // Dropped or never a candidate, so it can run and release
+				freeRes[t] += res->allocation[q];
+			else
+			{
+				heldRes.push_back(t);
+				heldNext.push_back(firstHeld[q]);
+				firstHeld[q] = heldRes.size() - 1;
+			}
+		}
+		sort(shortOf[t].begin(), shortOf[t].end());
+		meet(t);
+	}
+
+	// Hand back what each dropped candidate holds of the touched resources
+	while (nReady > 0)
+	{
+		int u = ready[--nReady];
+		for (int e = firstHeld[u]; e >= 0; e = heldNext[e])
+		{
+			int t = heldRes[e];
+			freeRes[t] += resTable[touched[t]].allocation[u];
+			meet(t);
+		}
+	}
+
+	// Keep the candidates left
+	int kept = 0;
+	for (int i = 0; i < dlCnt; i++)
+		if (seen[lastDl[i]] == seenEpoch)
+			lastDl[kept++] = lastDl[i];
+	dlCnt = kept;
+}
+
+// Function to find if process p, which has just blocked, is now deadlocked. A pending request is short of a resource when it asks for
+// more of it than is available, and waits for every process holding that resource. Collects the blocked processes reached from p this
+// way and drops every one that could still be granted all of any one of its requests. Cost is bounded by the pending requests of the
+// processes reached and the holders of what they are short of, not the size of the tables. If a deadlock is left, also adds any
+// blocked process waiting in the queue of a resource a member holds, since those may be stuck behind it, and drops again.
+// Deadlocked processes are left in lastDl in slot order, with the count in dlCnt
+bool deadlockFrom(int p)
+{
+	static int* stack = new int[nProc]; // Processes reached but not yet followed
+	int top = 0;
+	seenEpoch++;
+	dlCnt = 0;
+
+	// Process can still act
+	if (!blocked(p))
+		return false;
+
+	seen[p] = seenEpoch;
+	stack[top++] = p;
+	while (top > 0)
+	{
+		int q = stack[--top];
+		lastDl[dlCnt++] = q;
+
+		// Follow edges to each blocked holder of a resource one of q's requests is short of. Running holders are left out, since
+		// they can release
+		const PCB* pcb = &processTable[q];
+		for (int o = 0; o < pcb->nPending; o++)
+		{
+			for (int k = 0; k < pcb->ops[o].nUnits; k++)
+			{
+				int r = pcb->ops[o].units[k].resId;
+				if (pcb->ops[o].units[k].count <= resTable[r].available)
+					continue;
+				for (int h = 0; h < resTable[r].nHolders; h++)
+				{
+					int next = resTable[r].holders[h];
+					if (seen[next] != seenEpoch && blocked(next))
+					{
+						seen[next] = seenEpoch;
+						stack[top++] = next;
+					}
+				}
+			}
+		}
+	}
+	dropUnstuck();
+	if (dlCnt == 0)
+		return false;
+
+	// Processes blocked behind the deadlock may be deadlocked too, even though p cannot reach them. Add every blocked process waiting
+	// for a resource held by a member, directly or through others. Only done once a deadlock is found, which recovery then handles
+	// with a pass over the whole table anyway
+	for (int i = 0; i < dlCnt; i++)
+	{
+		int q = lastDl[i];
+		for (int r = 0; r < nRes; r++)
+		{
+			if (resTable[r].allocation[q] == 0)
+				continue;
+			for (int u = resTable[r].waitHead; u >= 0; u = resTable[r].waitNext[u])
+			{
+				if (seen[u] != seenEpoch && blocked(u))
+				{
+					seen[u] = seenEpoch;
+					lastDl[dlCnt++] = u;
+				}
+			}
+		}
+	}
+	dropUnstuck();
+
+	// Sort deadlocked processes by slot for output
+	for (int i = 1; i < dlCnt; i++)
+	{
+		int v = lastDl[i];
+		int j = i - 1;
+		while (j >= 0 && lastDl[j] > v)
+		{
+			lastDl[j + 1] = lastDl[j];
+			j--;
+		}
+		lastDl[j + 1] = v;
+	}
+	return dlCnt > 0;
+}
+
+// Function to detect and recover from a deadlock that process p may have formed by blocking
+void checkDeadlockFrom(int p)
 {
-	printf("3 seconds have passed, process(es) will now terminate.\n");
-	pid_t pid;
+	if (!deadlockFrom(p))
+		return;
+
+	uint64_t now = clockNow(shm_ptr);
+	dlRuns++;
+	totDlProcs += dlCnt;
 
-	// Loop through process table to find all processes still running and terminate
-	for (int i = 0; i < 18; i++)
+	// List deadlocked processes
+	logInfo("Master detected deadlock at time %u:%09u: Processes ", clockSec(now), clockNano(now));
+	for (int i = 0; i < dlCnt; i++)
 	{
-		if(processTable[i].occupied)
+		traceEvent(now, TRACE_DEADLOCK, lastDl[i], processTable[lastDl[i]].pid);
+		logInfo("P%d", lastDl[i]);
+		if (i < dlCnt - 1)
 		{
-			pid = processTable[i].pid;
-			if (pid > 0)
-				kill(pid, SIGKILL);
+			logInfo(", ");
 		}
 	}
-	 // Detach from shared memory and remove it
-        if(shmdt(shm_ptr) == -1)
-        {
-                perror("shmdt failed");
-                exit(1);
-        }
-        if (shmctl(shm_id, IPC_RMID, NULL) == -1)
-        {
-                perror("shmctl failed");
-                exit(1);
-        }
+	logInfo(" deadlocked\n");
 
-        // Remove the message queue
-        if (msgctl(msqid, IPC_RMID, NULL) == -1)
-        {
-                perror("msgctl failed");
-                exit(1);
-        }
-
-
-	exit(1);
+	// Only this deadlock can exist, since every earlier one was recovered from as it formed
+	recoverDeadlock();
 }
 
-// Function to check if process requests (p) for each resource type amount (m) is less than available resources (work[])
-bool req_lt_avail(int p, int m, int work[])
+// Function to check for deadlock from each process that was given part of its request while staying blocked. Recovery may give
+// out more partial grants, so keeps going until none are left
+void checkPartialWaiters()
 {
-	for (int i = 0; i < m; i++)
+	while (!partialWaiters.empty())
 	{
-		// Return false if requests are greater than available
-		if (resTable[i].request[p] > work[i])
-			return false;
+		int p = partialWaiters.back();
+		partialWaiters.pop_back();
+		if (processTable[p].occupied && blocked(p))
+			checkDeadlockFrom(p);
 	}
-	// Otherwise, return true
-	return true;
 }
 
-// Function to detect if system is deadlocked
-bool deadlock(int m, int n)
+// Function to write the (resource, count) pairs of a message into out as "R0:2, R3:1" for output. A single instance of one resource
+// is written as just "R0" unless counts is set
+void formatUnits(const msgbuffer& msg, char* out, bool counts)
 {
-	int work[m]; // Represents currently available resources
-	bool finish[n]; // Represents which processes can finish (true) and which cannot get requests met (false)
-
-	// Initialize work to currently available resources
-	for (int i = 0; i < m; i++)
+	int len = 0;
+	out[0] = '\0';
+	for (int i = 0; i < msg.nUnits; i++)
 	{
-		work[i] = resTable[i].available;
+		if (!counts && msg.nUnits == 1 && msg.units[i].count == 1)
+			len += sprintf(out + len, "R%d", msg.units[i].resId);
+		else
+			len += sprintf(out + len, "%sR%d:%d", i > 0 ? ", " : "", msg.units[i].resId, msg.units[i].count);
 	}
+}
 
-	// Initialize finsih to false initially
-	for (int i = 0; i < n; i++)
-		finish[i] = false;
+// Function to handle a request, release, claim, or sleep message from a worker that has been received into rcvbuf
+void handleMessage()
+{
+	// Look up index of process who sent message from its pid, -1 if it is no longer in the table
+	int indx = pidMapFind(&pidMap, rcvbuf.pid);
+	msgsHandled++;
 
-	// Loop through to find any processes that are able to finish
-	for (int i = 0; i < n; i++)
+	if (indx >= 0) // Determine if process's index was found
 	{
-		// Continue if process was determined able to finish
-		if (finish[i]) continue;
+		// In discrete event mode, sender is now blocked until it gets a reply, and oss charges the message overhead. A worker ending its
+		// lifetime is taken off active when it is reaped instead
+		if (des)
+		{
+			if (rcvbuf.kind != MSG_DONE)
+				active--;
+			addOverhead();
+		}
 
-		// If process is unoccupied in table, treat as finished
-		if (!processTable[i].occupied)
+		uint64_t now = clockNow(shm_ptr); // Time message was handled, read once for all output below
+		buf.seq = rcvbuf.seq; // Reply to this message carries its sequence number so the worker can match it
+		char units[MSG_UNITS * 32]; // Resources and counts the message carries, formatted for output
+		if (LOG_LEVEL >= LOG_MSG)
+			formatUnits(rcvbuf, units, rcvbuf.kind != MSG_REQUEST);
+		if (rcvbuf.kind == MSG_DONE) // Pooled process ended its lifetime, reap it as if it exited and keep it to start again
 		{
-			finish[i] = true;
-			continue;
+			reapWorker(indx, rcvbuf.pid);
+			serveFreed();
+			checkPartialWaiters();
+			idleWorkers.push_back(rcvbuf.pid);
 		}
-		// Determine if process's requests can be met
-		if (req_lt_avail(i, m, work))
+		else if (rcvbuf.kind == MSG_SLEEP) // Process is waiting for the clock, reply once it reaches wakeAt
 		{
-			// If true, mark process as able to finish
-			finish[i] = true;
-			// Release processes allocated resources back to work within the function
-			for (int j = 0; j < m; j++)
-				work[j] += resTable[j].allocation[i];
-			// Restart loop from 0 
-			i = -1;
+			deadlines.push({rcvbuf.wakeAt, indx, processTable[indx].pid, 0});
 		}
-	}
+		else if (rcvbuf.kind == MSG_CLAIM) // Process is declaring the most of each resource it will hold
+		{
+			logMsg("Master has detected Process P%d claiming up to %s at time %u:%09u\n", indx, units, clockSec(now), clockNano(now));
+			for (int i = 0; i < rcvbuf.nUnits; i++)
+			{
+				int r = rcvbuf.units[i].resId;
+				resTable[r].need[indx] = rcvbuf.units[i].count - resTable[r].allocation[indx];
+				traceEvent(now, TRACE_CLAIM, indx, rcvbuf.pid, r, rcvbuf.units[i].count);
+			}
 
-	// Represents count of deadlocked processes
-	int cnt = 0;
-	// Find processes that are unable to finish and increment count and add to currently deadlocked array
-	for (int i = 0; i < n; i++)
-	{
-		if (processTable[i].occupied && !finish[i])
+			// Acknowledge claim
+			buf.granted = true;
+			sendMsg(indx, "msgsnd claim");
+		}
+		else if (rcvbuf.kind == MSG_REQUEST) // Process is requesting
 		{
-			lastDl[cnt] = i;
-			cnt++;
+			logMsg("Master has detected Process P%d requesting %s at time %u:%09u\n", indx, units, clockSec(now), clockNano(now));
+			for (int i = 0; i < rcvbuf.nUnits; i++)
+				traceEvent(now, TRACE_REQUEST, indx, rcvbuf.pid, rcvbuf.units[i].resId, rcvbuf.units[i].count, rcvbuf.seq);
+
+			// In avoidance mode, a request past the process's claim is refused outright, counting what it already has pending
+			bool beyondClaim = false;
+			for (int i = 0; avoid && i < rcvbuf.nUnits; i++)
+			{
+				Resource* res = &resTable[rcvbuf.units[i].resId];
+				if (rcvbuf.units[i].count + res->request[indx] > res->need[indx])
+					beyondClaim = true;
+			}
+			// A worker never has more requests in flight than it was told, but do not overrun its row if it does
+			if (beyondClaim || processTable[indx].nPending == maxOps)
+			{
+				const char* why = beyondClaim ? "beyond its claim" : "with too many requests in flight";
+				logMsg("Master denying P%d requesting %s %s at time %u:%09u\n", indx, units, why, clockSec(now), clockNano(now));
+				buf.granted = false;
+				sendMsg(indx, "msgsnd deny");
+				traceEvent(now, TRACE_DENY, indx, rcvbuf.pid, -1, 0, rcvbuf.seq);
+				return;
+			}
+
+			// Record the whole request as pending, then grant what the request's mode allows
+			PendingOp* op = &processTable[indx].ops[processTable[indx].nPending++];
+			op->seq = rcvbuf.seq;
+			op->partial = rcvbuf.partial;
+			op->nUnits = rcvbuf.nUnits;
+			for (int i = 0; i < rcvbuf.nUnits; i++)
+			{
+				op->units[i] = rcvbuf.units[i];
+				resTable[rcvbuf.units[i].resId].request[indx] += rcvbuf.units[i].count;
+			}
+
+			// Determine if the whole request was granted, and in avoidance mode if granting it was safe
+			grantOp(indx, op);
+			if (opDone(op))
+			{
+				// Request is the newest pending, so drop it from the end
+				processTable[indx].nPending--;
+				// If true, notify worker
+				logMsg("Master granting P%d requesting %s at time %u:%09u \n", indx, units, clockSec(now), clockNano(now));
+
+				// Prepare message to send to worker
+				buf.granted = true; // Represents request being granted
+				// Send message to worker to notify that request is being granted
+				replyAt(indx, "msgsnd grant");
+				traceEvent(now, TRACE_GRANT, indx, rcvbuf.pid, -1, 0, rcvbuf.seq);
+				// Increment total immediate grants
+				immGrant++;
+				return;
+			}
+
+			// Add process to the wait queue of what it is short of, starting the clocks on its wait
+			op->waitSince = now;
+			op->waitSinceWall = wallNow();
+			if (blocked(indx))
+				processTable[indx].blockedSince = now;
+			syncQueues(indx);
+			int r = opShort(op);
+			if (r < 0) // Resources are available, but granting them could lead to deadlock
+			{
+				logMsg("Master: granting %s to P%d would be unsafe, P%d added to wait queue at time %u:%09u\n", units, indx, indx, clockSec(now), clockNano(now));
+				unsafeWaits++;
+				traceEvent(now, TRACE_UNSAFE, indx, rcvbuf.pid, -1, 0, rcvbuf.seq);
+			}
+			else // Unable to grant request, not enough of a requested resource
+			{
+				logMsg("Master: not enough instances of R%d available, P%d added to wait queue at time %u:%09u\n", r, indx, clockSec(now), clockNano(now));
+				traceEvent(now, TRACE_WAIT, indx, rcvbuf.pid, r, 0, rcvbuf.seq);
+
+				// A new deadlock can only form when a process blocks, so check from here when detecting incrementally
+				if (incremental)
+				{
+					checkDeadlockFrom(indx);
+					checkPartialWaiters();
+				}
+			}
 		}
-	}
+		else // Process is releasing
+		{
+			// Move each released instance from process back to available in resource and process tables
+			for (int i = 0; i < rcvbuf.nUnits; i++)
+			{
+				deallocate(indx, rcvbuf.units[i].resId, rcvbuf.units[i].count);
+				traceEvent(now, TRACE_RELEASE, indx, rcvbuf.pid, rcvbuf.units[i].resId, rcvbuf.units[i].count, rcvbuf.seq);
+			}
 
-	// Set global current deadlock count to cnt
-	dlCnt = cnt;
+			logMsg("Master has acknowledged Process P%d releasing %s at time %u:%09u\n", indx, units, clockSec(now), clockNano(now));
 
-	// Return false if no deadlocked processes were counted
-	if (cnt <= 0)
-		return false;
+			// Prepare message to send to worker
+			buf.granted = true; // Represents release being granted
+			// Send message to notify of release
+			replyAt(indx, "msgsnd release");
+			// List resources released
+			logMsg("	Resources released : %s\n", units);
 
-	// Otherwise, return true. Meaning deadlock.
-	else return true;
+			// In avoidance mode, the release may make a waiting request on any resource safe
+			if (avoid)
+				grantSafeWaiters();
+			// Otherwise serve the wait queue of each resource released
+			else
+			{
+				for (int i = 0; i < rcvbuf.nUnits; i++)
+					serveQueue(rcvbuf.units[i].resId);
+				checkPartialWaiters();
+			}
+		}
+
+	}
 }
 
-// Function to recover from deadlock state by choosing a deadlocked process and killling it
-void recoverDeadlock(int m, int n)
+// Function to print the count, mean, percentiles, and max of a histogram of ns, divided by scale and labelled with unit
+void printLatency(const char* what, const Histogram* h, double scale, const char* unit)
 {
-	
-	int work[m]; // Represents resources available during recovery
-	bool finish[n]; // Represents which processes can finish (true) or stay in deadlock (false)
-
-	// Initialize work to current available resources
-	for (int i = 0; i < m; i++)
+	logStat("%s: %llu recorded", what, (unsigned long long)h->total);
+	if (h->total > 0)
 	{
-		work[i] = resTable[i].available;
+		logStat(", mean %.3f%s, p50 %.3f%s, p90 %.3f%s, p99 %.3f%s, p99.9 %.3f%s, max %.3f%s", histMean(h) / scale, unit,
+			histPercentile(h, 0.5) / scale, unit, histPercentile(h, 0.9) / scale, unit, histPercentile(h, 0.99) / scale, unit,
+			histPercentile(h, 0.999) / scale, unit, h->max / scale, unit);
 	}
-	// Initialize finish to false initially
-	for (int i = 0; i < n; i++)
+	logStat("\n");
+}
+
+// Function to read table sizes from a config file into options. Each line is a key followed by its values, and blank lines and lines
+// starting with # are skipped:
+//     proc N           total processes to launch
+//     simul N          most processes running at once, which is also the size of the process table
+//     resources N      amount of resource types
+//     instances N...   instances of each resource type in order, the last one repeats for any types not listed
+// Returns false after printing an error if the file cannot be read or has a bad line
+bool readConfig(const char* path, options_t& options)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
 	{
-		finish[i] = false;
+		fprintf(stderr, "Error! Failed to open config file %s.\n", path);
+		return false;
 	}
 
-	bool prog; // Represents if any process has made progress in previous loop
-	
-	// Determine if any processes have requests that can be met
-	do
+	char line[4096];
+	int lineNum = 0;
+	while (fgets(line, sizeof(line), file) != NULL)
 	{
-		// Initially false
-		prog = false;
-		// Loop through and determine if any process is occupied, not marked as finished, and able to have requests met
-		for (int i = 0; i < n; i++)
+		lineNum++;
+		char* key = strtok(line, " \t\r\n");
+		// Skip blank lines and comments
+		if (key == NULL || key[0] == '#')
+			continue;
+
+		// Read every value after the key, making sure each is a number
+		vector<int> vals;
+		char* val;
+		while ((val = strtok(NULL, " \t\r\n")) != NULL)
 		{
-			if (!finish[i] && processTable[i].occupied && req_lt_avail(i, m, work))
+			for (int i = 0; val[i] != '\0'; i++)
 			{
-				// If true, set finsih for process i to true
-				finish[i] = true;
-				// Set prog to true since progress was made
-				prog = true;
-				// Release processes allocated resources back to work within the function
-				for (int j = 0; j < m; j++)
-					work[j] += resTable[j].allocation[i];
+				if (!isdigit(val[i]))
+				{
+					fprintf(stderr, "Error! %s:%d: %s is not a valid number.\n", path, lineNum, val);
+					fclose(file);
+					return false;
+				}
 			}
+			vals.push_back(atoi(val));
 		}
-	} while (prog);
 
-	// Reprsents pid of process to be killed
-	int victim = -1;
-	// Loop through and find process that is occupied and unable to finish
-	for (int i = 0; i < n; i++)
-	{
-		if (processTable[i].occupied && !finish[i])
+		bool single = strcmp(key, "proc") == 0 || strcmp(key, "simul") == 0 || strcmp(key, "resources") == 0;
+		if (vals.empty() || (single && vals.size() != 1))
 		{
-			// If true, set victim to i and break
-			victim = i;
-			break;
+			fprintf(stderr, "Error! %s:%d: wrong amount of values for %s.\n", path, lineNum, key);
+			fclose(file);
+			return false;
 		}
-	}
 
-	// Return if victim is less than 0, means no victim was found
-	if (victim < 0)
-		return;
+		if (strcmp(key, "proc") == 0)
+			options.proc = vals[0];
+		else if (strcmp(key, "simul") == 0)
+			options.simul = vals[0];
+		else if (strcmp(key, "resources") == 0)
+			options.resources = vals[0];
+		else if (strcmp(key, "instances") == 0)
+			options.instances = vals;
+		else
+		{
+			fprintf(stderr, "Error! %s:%d: unknown setting %s.\n", path, lineNum, key);
+			fclose(file);
+			return false;
+		}
+	}
+	fclose(file);
+	return true;
+}
 
-	// Represents how many of each resource is held by victim
-	int rHeld[MAX_RES];
-	for (int i = 0; i < m; i++)
+// Function to allocate the process and resource tables once nProc and nRes are known. Matrices are single blocks with a row per
+// resource, or per slot for held, and every entry starts empty
+void setupTables(const options_t& options)
+{
+	allocMat = matrixAlloc(nRes, nProc);
+	reqMat = matrixAlloc(nRes, nProc);
+	needMat = matrixAlloc(nRes, nProc);
+	waitMat = maxOps > 1 ? matrixAlloc(nRes, nProc * maxOps) : NULL;
+	heldMat = new int[(size_t)nProc * nRes]();
+	holderMat = new int[(size_t)nRes * nProc];
+	holderPosMat = new int[(size_t)nRes * nProc];
+	waitNextMat = new int[(size_t)nRes * nProc];
+	waitPrevMat = new int[(size_t)nRes * nProc];
+	if (allocMat == NULL || reqMat == NULL || needMat == NULL || (maxOps > 1 && waitMat == NULL))
 	{
-		rHeld[i] = processTable[victim].held[i];
+		fprintf(stderr, "Error! Failed to allocate resource tables.\n");
+		exit(1);
 	}
-	// Find victim's pid in process table
-	pid_t vpid = processTable[victim].pid;
-
-	printf("   Master terminating P%d to remove deadlock\n", victim);
-	if (logging) fprintf(logfile, "    Master terminating P%d to remove deadlock\n", victim);
-
-	// Kill victim and wait for it to finish
-	kill(vpid, SIGKILL);
-	waitpid(vpid, NULL, 0);
-	dlKills++;
-
-	printf("   Process P%d terminated\n", victim);
-	if (logging) fprintf(logfile, "   Process P%d terminated\n", victim);
-	printf("   Resources released: ");
-	if (logging) fprintf(logfile, "   Resources released: ");
+	opMat = new PendingOp[(size_t)nProc * maxOps];
+	lastDl = new int[nProc];
+	seen = new int[nProc]();
+	freed = new bool[nRes]();
+	snapBuf = new char[snapBytes(nProc, nRes)];
+	snapRows = new char[(size_t)nProc * (16 + (size_t)nRes * 12)];
+	if (deltaPrint)
+	{
+		lastHeldMat = new int[(size_t)nProc * nRes]();
+		lastPid = new pid_t[nProc]();
+	}
+	pidMapInit(&pidMap, nProc);
 
-	// Loop through and list all resources released by victim
-	bool first = true; // Represents if first resource has been printed. Used to determine when to print commas.
-	for (int i = 0; i < m; i++)
+	// Initialize process table, all values set to empty
+	processTable = new PCB[nProc];
+	for (int i = 0; i < nProc; i++)
 	{
-		// Print resource if more than 0
-		if (rHeld[i] > 0)
-		{
-			if (!first)
-			{
-				printf(", ");
-				if (logging) fprintf(logfile, ", ");
-			}
-			printf("R%d:%d", i, rHeld[i]);
-			if (logging) fprintf(logfile, "R%d:%d", i, rHeld[i]);
-			first = false;
-		}
+		// Set occupied to 0
+		processTable[i].occupied = 0;
+		// Set pending requests to 0, meaning process is not waiting for any resource
+		processTable[i].nPending = 0;
+		processTable[i].ops = &opMat[(size_t)i * maxOps];
+		// Point at slot's row of held resources, already set to 0
+		processTable[i].held = &heldMat[(size_t)i * nRes];
 	}
-	printf("\n");
-	if (logging) fprintf(logfile, "\n");
 
-	// Put resources held by victim back into resource and clear victim's held resources
-	for (int i = 0; i < m; i++)
+	// Initialize resource table with every instance available
+	resTable = new Resource[nRes];
+	for (int i = 0; i < nRes; i++)
 	{
-		int held = processTable[victim].held[i];
-		if (held > 0)
+		int inst = options.instances[min((size_t)i, options.instances.size() - 1)];
+		resTable[i].total = inst;
+		resTable[i].available = inst;
+		resTable[i].nHolders = 0;
+		resTable[i].allocation = &allocMat[(size_t)i * matrixStride(nProc)];
+		resTable[i].request = &reqMat[(size_t)i * matrixStride(nProc)];
+		resTable[i].need = &needMat[(size_t)i * matrixStride(nProc)];
+		resTable[i].holders = &holderMat[(size_t)i * nProc];
+		resTable[i].holderPos = &holderPosMat[(size_t)i * nProc];
+		resTable[i].waitNext = &waitNextMat[(size_t)i * nProc];
+		resTable[i].waitPrev = &waitPrevMat[(size_t)i * nProc];
+		for (int j = 0; j < nProc; j++)
 		{
-			resTable[i].available += held;
-			resTable[i].allocation[victim] = 0;
-			processTable[victim].held[i] = 0;
-		}
-		// Clear any requests from victim
-		resTable[i].request[victim] = 0;
-
-		// Loop through to find any processes waiting for resource and see if request can be mad
-		while (!resTable[i].waitQueue.empty() && resTable[i].available > 0)
-		{// If able to meet request
-			// Take next process in queue off queue and get its index
-			int indx = resTable[i].waitQueue.front();
-			resTable[i].waitQueue.pop();
-
-			// Allocate resource from available resources to resources allocated to process
-			resTable[i].available--;
-			resTable[i].allocation[indx]++;
-			processTable[indx].held[i]++;
-			// Decrement process request
-			resTable[i].request[indx]--;
-
-			// Send message to process to grant resource request
-			buf.mtype = processTable[indx].pid;
-			buf.granted = true;
-			if (msgsnd(msqid, &buf, sizeof(buf) - sizeof(long), 0) == -1)
-			{
-				perror("msgsnd recovery wakeup");
-				exit(1);
-			}
-			
-
+			resTable[i].holderPos[j] = -1;
+			resTable[i].waitPrev[j] = NOT_WAITING;
 		}
 	}
-
-	// Mark victim as unoccupied in process table 
-	processTable[victim].occupied = 0;
-	// Decrement amount of currently running processes
-	running--;
-	
-
 }
 
 int main(int argc, char* argv[])
 {
+	// Start the thread that writes output in the background, printing directly if it cannot be started
+	logStart();
+
 	// Signal that will terminate program after 3 sec (real time)
 	signal(SIGALRM, signal_handler);
-	alarm(3);
 
 	key_t key; // Key to access queue
 
@@ -511,7 +1892,7 @@ int main(int argc, char* argv[])
 		exit(1);
 	}	
 
-	printf("Message queue set up\n");
+	logInfo("Message queue set up\n");
 
 	// Structure to hold values for options in command line argument
 	options_t options;
@@ -520,6 +1901,17 @@ int main(int argc, char* argv[])
 	options.proc = 1;
 	options.simul = 1;
 	options.interval = 0;
+	options.event = false;
+	options.ring = false;
+	options.clockWait = false;
+	options.des = false;
+	options.incremental = false;
+	options.avoid = false;
+	options.resources = DEF_RES;
+	options.burst = 1;
+	options.ops = 1;
+	options.threads = 0;
+	options.pool = false;
 
 
 	// Values to keep track of child iterations
@@ -527,9 +1919,8 @@ int main(int argc, char* argv[])
 	running = 0;
 	//int lastForkSec = 0; // Time in sec since last fork
 	//int lastForkNs = 0; // Time in ns since last fork
-	int msgsnt = 0;
 
-	const char optstr[] = "hn:s:t:i:f"; // Options h, n, s, t, i, f
+	const char optstr[] = "hn:s:t:i:ferwdgk:bm:u:x:a:lo:pc:"; // Options h, n, s, t, i, f, e, r, w, d, g, k, b, m, u, x, a, l, o, p, c
 	char opt;
 	
 	// Parse command line arguments with getopt
@@ -546,7 +1937,7 @@ int main(int argc, char* argv[])
 				if (optarg[0] == '-')
 				{
 					// Check if next character starts with other option, meaning no argument given for n and another option given
-					if (optarg[1] == 's' || optarg[1] == 'i' || optarg[1] == 'f' ||  optarg[1] == 'h')
+					if (optarg[1] == 's' || optarg[1] == 'i' || optarg[1] == 'f' || optarg[1] == 'e' || optarg[1] == 'r' || optarg[1] == 'w' || optarg[1] == 'd' || optarg[1] == 'g' || optarg[1] == 'k' || optarg[1] == 'b' || optarg[1] == 'm' || optarg[1] == 'u' || optarg[1] == 'x' || optarg[1] == 'a' || optarg[1] == 't' || optarg[1] == 'l' || optarg[1] == 'o' || optarg[1] == 'p' || optarg[1] == 'c' || optarg[1] == 'h')
 					{
 						// Print an error statement, print usage, and exit program
 						fprintf(stderr, "Error! Option n requires an argument.\n");
@@ -581,7 +1972,7 @@ int main(int argc, char* argv[])
 				if (optarg[0] == '-')
 				{
 					// Check if next character starts with other option, meaning no argument given for n and another option given
-					if (optarg[1] == 'n' || optarg[1] == 'i' || optarg[1] == 'f' ||  optarg[1] == 'h')
+					if (optarg[1] == 'n' || optarg[1] == 'i' || optarg[1] == 'f' || optarg[1] == 'e' || optarg[1] == 'r' || optarg[1] == 'w' || optarg[1] == 'd' || optarg[1] == 'g' || optarg[1] == 'k' || optarg[1] == 'b' || optarg[1] == 'm' || optarg[1] == 'u' || optarg[1] == 'x' || optarg[1] == 'a' || optarg[1] == 't' || optarg[1] == 'l' || optarg[1] == 'o' || optarg[1] == 'p' || optarg[1] == 'c' || optarg[1] == 'h')
 					{
 						// Print an error statement, print usage, and exit program
 						fprintf(stderr, "Error! Option s requires an argument.\n");
@@ -608,12 +1999,6 @@ int main(int argc, char* argv[])
 
 				// Set simul to optarg and break
 				options.simul = atoi(optarg);
-				if (options.simul > 18)
-				{
-					fprintf(stderr, "Error! Value entered for options s cannot exceed 18. %d > 18.\n", options.simul);
-					print_usage(argv[0]);
-					return EXIT_FAILURE;
-				}
 				break;
 
 			case 'i':
@@ -621,7 +2006,7 @@ int main(int argc, char* argv[])
 				if (optarg[0] == '-')
 				{
 					// Checks if next character is character of other option, meaning no argument given for i and another option given
-					if (optarg[1] == 'n' || optarg[1] == 's' || optarg[1] == 'f' ||  optarg[1] == 'h')
+					if (optarg[1] == 'n' || optarg[1] == 's' || optarg[1] == 'f' || optarg[1] == 'e' || optarg[1] == 'r' || optarg[1] == 'w' || optarg[1] == 'd' || optarg[1] == 'g' || optarg[1] == 'k' || optarg[1] == 'b' || optarg[1] == 'm' || optarg[1] == 'u' || optarg[1] == 'x' || optarg[1] == 'a' || optarg[1] == 't' || optarg[1] == 'l' || optarg[1] == 'o' || optarg[1] == 'p' || optarg[1] == 'c' || optarg[1] == 'h')
 					{
 						// Print error statement, print usage, and exit program
 						fprintf(stderr, "Error! Option i requires an argument.\n");
@@ -652,16 +2037,118 @@ int main(int argc, char* argv[])
 				break;
 
 			case 'f': // Print output also to logfile if option is passed
-				logging = true;
 				// Open logfile
-				logfile = fopen("ossLog.txt", "w");
-				if (logfile == NULL)
+				if (!logOpenFile("ossLog.txt"))
 				{
 					fprintf(stderr, "Error! Failed to open logfile.\n");
 					return EXIT_FAILURE;
 				}
 				break;
 
+			case 'e': // Event driven main loop
+				options.event = true;
+				break;
+
+			case 'r': // Shared memory ring transport
+				options.ring = true;
+				break;
+
+			case 'w': // Workers wait on clock
+				options.clockWait = true;
+				clockWaits = true;
+				break;
+
+			case 'd': // Discrete event simulation
+				options.des = true;
+				des = true;
+				break;
+
+			case 'g': // Incremental wait-for graph deadlock detection
+				options.incremental = true;
+				incremental = true;
+				break;
+
+			case 'k': // Cost used to choose deadlock victims
+				if (strcmp(optarg, "held") == 0)
+					victimCost = costHeld;
+				else if (strcmp(optarg, "runtime") == 0)
+					victimCost = costRuntime;
+				else if (strcmp(optarg, "waiters") == 0)
+					victimCost = costWaiters;
+				else
+				{
+					// Print error statement, print usage, and exit program
+					fprintf(stderr, "Error! %s is not a valid cost. Use held, runtime, or waiters.\n", optarg);
+					print_usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'b': // Banker's algorithm deadlock avoidance
+				options.avoid = true;
+				avoid = true;
+				break;
+
+			case 'l': // Pool of reusable worker processes
+				options.pool = true;
+				break;
+
+			case 'm': // Amount of resource types
+			case 'u': // Instances of each resource type
+			case 'x': // Most instances per request
+			case 'a': // Most operations in flight per worker
+			case 't': // Threads running workers as tasks
+				// Checks if argument starts with '-'
+				if (optarg[0] == '-')
+				{
+					// Print error statement, print usage, and exit program
+					fprintf(stderr, "Error! Option %c requires an argument.\n", opt);
+					print_usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				// Loop to ensure all characters in argument are digits
+				for (int i = 0; optarg[i] != '\0'; i++)
+				{
+					if (!isdigit(optarg[i]))
+					{
+						fprintf(stderr, "Error! %s is not a valid number.\n", optarg);
+						print_usage(argv[0]);
+						return EXIT_FAILURE;
+					}
+				}
+
+				if (opt == 'm')
+					options.resources = atoi(optarg);
+				else if (opt == 'u')
+					options.instances.assign(1, atoi(optarg));
+				else if (opt == 'x')
+					options.burst = atoi(optarg);
+				else if (opt == 'a')
+					options.ops = atoi(optarg);
+				else
+					options.threads = atoi(optarg);
+				break;
+
+			case 'o': // Binary event trace
+				if (!traceOpen(optarg))
+				{
+					fprintf(stderr, "Error! Failed to open trace file %s.\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'p': // Print only changed table rows
+				deltaPrint = true;
+				break;
+
+			case 'c': // Read table sizes from config file
+				if (!readConfig(optarg, options))
+				{
+					print_usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+
 			default:
 				// Prints message that option given is invalid, prints usage, and exits program
 				fprintf(stderr, "Error! Invalid option %c.\n", optopt);
@@ -671,382 +2158,416 @@ int main(int argc, char* argv[])
 	}
 			
 
-	// Set up shared memory for clock
+	// Determine if table sizes are usable
+	if (options.simul < 1 || options.resources < 1 || options.burst < 1)
+	{
+		fprintf(stderr, "Error! Need at least 1 simultaneous process, 1 resource type, and 1 instance per request.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	// Each operation in flight gets one reply, so a worker's mailbox can always hold every reply it is owed
+	if (options.ops < 1 || options.ops > MAILBOX_SIZE)
+	{
+		fprintf(stderr, "Error! Operations in flight must be between 1 and %d.\n", MAILBOX_SIZE);
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	// Discrete event mode counts a worker as blocked from each message until its reply, which only holds for one at a time
+	if (options.ops > 1 && options.des)
+	{
+		fprintf(stderr, "Error! Option a cannot be above 1 with option d.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < options.instances.size(); i++)
+	{
+		if (options.instances[i] < 1)
+		{
+			fprintf(stderr, "Error! Every resource type needs at least 1 instance.\n");
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (options.instances.empty())
+		options.instances.assign(1, DEF_INST);
+
+	// Size tables to the most processes that can run at once and the amount of resource types
+	nProc = options.simul;
+	nRes = options.resources;
+	maxOps = options.ops;
+	setupTables(options);
+
+	// Every slot starts out free, taken lowest first
+	for (int i = nProc - 1; i >= 0; i--)
+		freeSlots.push_back(i);
+
+	// Set up shared memory for clock and live statistics
 	shareMem();
+	setupStats();
 
-	// Allocate memory for process table based on total processes
-	processTable = new PCB[20];
+	// Discrete event mode is not limited by real time, since the simulation no longer depends on how fast the host runs.
+	// It sleeps between events the same way event mode does, and workers sleep on messages so the clock-wait mode is not used
+	if (options.des)
+	{
+		options.event = true;
+		options.clockWait = false;
+		clockWaits = false;
+	}
+	else
+		alarm(3);
 
-	resTable = new Resource[5];
-	for (int i = 0; i < 5; i++)
+	// Tasks run inside oss and talk to it through the transport kept on the heap. They check their own wake times on every pass, so the
+	// clock-wait mode is not used either
+	if (options.threads > 0)
 	{
-		resTable[i].total = 10;
-		resTable[i].available = 10;
-		for (int j = 0; j < 18; j++)
-		{
-			resTable[i].allocation[j] = 0;
-			resTable[i].request[j] = 0;
-		}
+		tasks = true;
+		options.ring = true;
+		options.clockWait = false;
+		clockWaits = false;
 	}
-	// Variables to track last printed time
-	long long int lastPrintSec = shm_ptr[0];
-	long long int lastPrintNs = shm_ptr[1];
 
-	// Variables to track last deadlock check
-	long long lastChkSec = shm_ptr[0];
-	long long lastChkNs = shm_ptr[1];
+	if (options.ring)
+		setupRing();
 
-	// Initialize process table, all values set to empty
-	for (int i = 0; i < MAX_PROC; i++)
+	// Start the threads that run tasks, each task set up like a worker would be from its arguments
+	vector<int> totals(nRes); // Instances of each resource, for the tasks to read
+	vector<int> exitedSlots(nProc); // Slots of tasks reaped in one pass
+	if (tasks)
 	{
-		// Set occupied to 0
-		processTable[i].occupied = 0;
-		// Set waitingon to -1, meaning process is not waiting for any resource
-		processTable[i].waitingOn = -1; 
-		for (int j = 0; j < MAX_RES; j++) 
+		for (int i = 0; i < nRes; i++)
+			totals[i] = resTable[i].total;
+		Client proto;
+		proto.clock = shm_ptr;
+		proto.nRes = nRes;
+		proto.total = totals.data();
+		proto.burst = options.burst;
+		proto.maxOps = maxOps;
+		proto.des = options.des;
+		proto.avoid = options.avoid;
+		if (!taskPoolStart(nProc, options.threads, ring, &proto))
 		{
-			// Set held resources to 0
-			processTable[i].held[j] = 0;
+			fprintf(stderr, "Error! Failed to start task threads.\n");
+			exit(1);
 		}
 	}
 
-	// Calculate current system time in ns
-	long long currTimeNs = (long long)shm_ptr[0] * 1000000000 + shm_ptr[1];
+	// Arguments telling workers the amount of resource types, the instances of each, the most to request at once and keep in flight,
+	// which transport and clock wait mode to use, if they must declare a claim, and if they are pooled
+	string instArg;
+	for (int i = 0; i < nRes; i++)
+		instArg += (i > 0 ? "," : "") + to_string(resTable[i].total);
+	workerArgs = {"-m", to_string(nRes), "-u", instArg, "-x", to_string(options.burst), "-a", to_string(options.ops)};
+	if (ring != NULL)
+		workerArgs.push_back("-r");
+	if (options.clockWait)
+		workerArgs.push_back("-w");
+	if (options.des)
+		workerArgs.push_back("-d");
+	if (options.avoid)
+		workerArgs.push_back("-b");
+
+	// Launch the pool up front, an idle worker for each that can run at once, so starting a worker later only takes a message. Tasks
+	// are already started without a new process
+	pool = options.pool && !tasks;
+	if (pool)
+	{
+		workerArgs.push_back("-l");
+		for (int i = 0; i < min(options.simul, options.proc); i++)
+			idleWorkers.push_back(launchWorker(-1));
+	}
+
+	if (options.event)
+		setupEventMode();
+
+	// Variable to track last printed time
+	uint64_t lastPrintNs = clockNow(shm_ptr);
+
+	// Variable to track last deadlock check
+	uint64_t lastChkNs = clockNow(shm_ptr);
+
+	// Get current system time in ns
+	uint64_t currTimeNs = clockNow(shm_ptr);
 	// Calculate next time to spawn a process based on command line value given for interval
-	long long nSpawnT = currTimeNs + options.interval;
+	uint64_t nSpawnT = currTimeNs + options.interval;
 
-	// Loop that will continue until total amount of processes given are launched and all running processes are terminated
-	while (total < options.proc ||  running > 0)
+	// Variable to track real time statistics were last published
+	uint64_t lastPublishWall = wallNow();
+	publishStats(total);
+
+	// Loop that will continue until total amount of processes given are launched and all running processes are terminated, or time is up
+	while ((total < options.proc ||  running > 0) && !timeUp)
 	{
-		// Update system clock
-		incrementClock();
+		if (options.event)
+		{
+			// Determine if a child exit or timer deadline is already waiting to be handled
+			currTimeNs = clockNow(shm_ptr);
+			bool canSpawn = total < options.proc && running < options.simul;
+			bool due = childExited
+				|| (tasks && taskExitsPending())
+				|| (options.des && active == 0)
+				|| (currTimeNs >= nSpawnT && canSpawn)
+				|| (!options.incremental && currTimeNs - lastChkNs >= NS_PER_SEC)
+				|| currTimeNs - lastPrintNs >= NS_PER_SEC / 2;
+
+			// Sleep only if nothing is due, until the next spawn, print, or detection at the latest
+			uint64_t steps = 0;
+			uint64_t sleepStart = 0;
+			if (!due)
+			{
+				uint64_t next = lastPrintNs + NS_PER_SEC / 2;
+				if (canSpawn && nSpawnT < next)
+					next = nSpawnT;
+				if (!options.incremental && lastChkNs + NS_PER_SEC < next)
+					next = lastChkNs + NS_PER_SEC;
+				steps = armSleep(currTimeNs, next);
+				sleepStart = wallNow();
+			}
+			bool received = recvMsg(!due);
+			if (!due)
+				endSleep(steps, wallNow() - sleepStart);
+
+			// Then drain every waiting message before doing housekeeping below
+			if (received)
+			{
+				do
+					handleMessage();
+				while (recvMsg(false));
+			}
+		}
+
+		// Update system clock. In discrete event mode, jump to the next event once every worker is blocked
+		if (!options.des)
+			incrementClock();
+		else if (active == 0)
+		{
+			uint64_t nextSpawn = (total < options.proc && running < options.simul) ? nSpawnT : UINT64_MAX;
+			uint64_t nextChk = options.incremental ? UINT64_MAX : lastChkNs + NS_PER_SEC;
+			jumpClock(nextSpawn, lastPrintNs + NS_PER_SEC / 2, nextChk);
+		}
 
 		// Loop through and terminate any process that are finished
 		pid_t pid;
 		int status;
-		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		bool reaped = false; // Represents if any process was reaped, so waiters are served once for all of them
+		childExited = 0;
+		while (!tasks && (pid = waitpid(-1, &status, WNOHANG)) > 0)
 		{
-			// Increment regular terminations
-			regTerms++;
-
-			// Find process's location in process table
-			int indx;
-			for (int i = 0; i < options.proc; i++)
+			// Find process's location in process table, skipping any child that is not in it. A pooled worker that died while idle
+			// is not started again
+			int indx = pidMapFind(&pidMap, pid);
+			if (indx < 0)
 			{
-				if (processTable[i].occupied == 1 && processTable[i].pid == pid)
-				{
-					indx = i;
-					break;
-				}
+				idleWorkers.erase(remove(idleWorkers.begin(), idleWorkers.end(), pid), idleWorkers.end());
+				continue;
 			}
+			// A worker that died by surprise may have left a cell in the ring claimed
+			if (ring != NULL)
+				ringDropDead(ring, indx);
+			reapWorker(indx, pid);
+			reaped = true;
+		}
+		// Tasks that exited are reaped the same way
+		int nExited = tasks ? taskReap(exitedSlots.data()) : 0;
+		for (int i = 0; i < nExited; i++)
+		{
+			reapWorker(exitedSlots[i], processTable[exitedSlots[i]].pid);
+			reaped = true;
+		}
 
-			// Use process table index to clear values for process
-			for (int i = 0; i < MAX_RES; i++)
-			{
-				// Set request in resource table for process to 0
-				resTable[i].request[indx] = 0;
-
-				queue<int> temp; // Temporary queue to loop through wait queue
-				// Loop through wait queue to determine if finished process is in queue
-				while(!resTable[i].waitQueue.empty())
-				{
-					// Incrementally remove processes from wait queue
-					int qIndx = resTable[i].waitQueue.front();
-					resTable[i].waitQueue.pop();
-					// If queue index does not match processs, add to temp queue
-					if (qIndx != indx)
-						temp.push(qIndx);
-				}
-				// Set waitqueue to temp queue
-				resTable[i].waitQueue = temp;
-			}
-			// Mark finished process as unoccupied in process table
-			processTable[indx].occupied = 0;
-			// Decrement total processes running
-			running--;
+		// Hand everything the exited processes held to waiting processes in one pass. In avoidance mode the processes no longer
+		// need the rest of their claims either, which may make waiting requests safe
+		if (reaped)
+		{
+			serveFreed();
+			checkPartialWaiters();
 		}
 
-		// Calculate time since last deadlock check for sec and ns
-		long long chkDiffSec = shm_ptr[0] - lastChkSec;
-		long long chkDiffNs = shm_ptr[1] - lastChkNs;
-		// Adjust ns value for subtraction resulting in negative value
-		if (chkDiffNs < 0)
+		// Take one snapshot of the clock for the timer checks below
+		currTimeNs = clockNow(shm_ptr);
+
+		// Publish live statistics on a real time period, so how often does not depend on how fast the simulated clock runs
+		uint64_t nowWall = wallNow();
+		if (nowWall - lastPublishWall >= STATS_PERIOD_NS)
 		{
-			chkDiffSec--;
-			chkDiffNs += 1000000000;
+			publishStats(total);
+			lastPublishWall = nowWall;
 		}
-		// Calculate total time since last deadlock check in ns
-		long long chkTotDiff = chkDiffSec * 1000000000 + chkDiffNs;
 
-		if (chkTotDiff >= 1000000000) // Determine if time of last dl check surpassed 1 sec system time
+		// Determine if time of last dl check surpassed 1 sec system time. Not needed when deadlocks are caught as they form
+		if (!options.incremental && currTimeNs - lastChkNs >= NS_PER_SEC)
 		{
-			printf("Master running deadlock detection at time %d:%09d: ", shm_ptr[0], shm_ptr[1]);
-			if (logging) fprintf(logfile, "Master running deadlock detection at time %d:%09d: ", shm_ptr[0], shm_ptr[1]);
-			if (deadlock(MAX_RES, options.simul)) // Check for deadlock
+			logInfo("Master running deadlock detection at time %u:%09u: ", clockSec(currTimeNs), clockNano(currTimeNs));
+			if (deadlock()) // Check for deadlock
 			{
 				// If true, increment the amount of deadlock runs and add deadlocked processes to total amount
 				dlRuns++;
 				totDlProcs += dlCnt;
 				// List deadlocked processes
-				printf("Processes ");
-				if (logging) fprintf(logfile, "Processes ");
+				logInfo("Processes ");
 				for (int i = 0; i < dlCnt; i++)
 				{
-					printf("P%d",lastDl[i]);
-					if (logging) fprintf(logfile, "P%d", lastDl[i]);
+					traceEvent(currTimeNs, TRACE_DEADLOCK, lastDl[i], processTable[lastDl[i]].pid);
+					logInfo("P%d",lastDl[i]);
 					if (i < dlCnt - 1)
 					{
-						printf(", ");
-						if(logging) fprintf(logfile, ", ");
+						logInfo(", ");
 					}
 				}
-				printf(" deadlocked\n");
-				if (logging) fprintf(logfile, " deadlocked\n");
+				logInfo(" deadlocked\n");
 			}
 			else // Otherwise, report no deadlock
 			{ 
-				printf("No deadlocks detected\n");
-				if (logging) fprintf(logfile, "No deadlocks detected\n");
+				logInfo("No deadlocks detected\n");
 			}
 
-			while (deadlock(MAX_RES, options.simul))
+			while (deadlock())
 			{
-				recoverDeadlock(MAX_RES, options.simul);
+				recoverDeadlock();
 			}
 			
-			// Update time since last dl check to current system time for sec and ns
-			lastChkSec = shm_ptr[0];
-			lastChkNs = shm_ptr[1];
-		}
-
-		// Calculate time since last print for sec and ns
-		long long int printDiffSec = shm_ptr[0] - lastPrintSec;
-		long long int printDiffNs = shm_ptr[1] - lastPrintNs;
-		// Adjust ns value for subtraction resulting in negative value
-		if (printDiffNs < 0)
-		{
-			printDiffSec--;
-			printDiffNs += 1000000000;
+			// Update time since last dl check to current system time
+			lastChkNs = currTimeNs;
 		}
-		// Calculate total time sincd last print in ns
-		long long int printTotDiff = printDiffSec * 1000000000 + printDiffNs;
 
-		if (printTotDiff >= 500000000) // Determine if time of last print surpasssed .5 sec system time
+		if (currTimeNs - lastPrintNs >= NS_PER_SEC / 2) // Determine if time of last print surpasssed .5 sec system time
 		{
-			// If true, print table and update time since last print in sec and ns
-			printInfo(18);
-			lastPrintSec = shm_ptr[0];
-			lastPrintNs = shm_ptr[1];
+			// If true, print table and update time since last print
+			printInfo(nProc);
+			lastPrintNs = currTimeNs;
 		}
 
-		currTimeNs = (long long)shm_ptr[0] * 1000000000 + shm_ptr[1];
+		currTimeNs = clockNow(shm_ptr);
 		// Determine if a new child process can be spawned
-		// Must be greater than next spawn time, less than total process allowed (100), and less than simultanous processes allowed (18)
-		if (currTimeNs >= nSpawnT && total < options.proc  && running < options.simul)
+		// Must be greater than next spawn time, less than total process allowed, and less than simultanous processes allowed
+		// Tasks and pooled workers keep being started while that holds, new worker processes one per pass
+		while (currTimeNs >= nSpawnT && total < options.proc  && running < options.simul)
 		{
-			//Fork new child
-			pid_t childPid = fork();
-			if (childPid == 0) // Child process
+			uint64_t spawnStart = wallNow();
+
+			// Take a free slot in process table for new child
+			int slot = freeSlots.back();
+			freeSlots.pop_back();
+			// Give the slot an empty mailbox before its new worker can use it
+			if (ring != NULL)
+				mailboxReset(transportMailbox(ring, slot));
+
+			// Take the next task id in place of a pid, an idle worker from the pool, or launch a new worker process
+			pid_t childPid;
+			bool launched = false;
+			if (tasks)
+				childPid = nextTaskPid++;
+			else if (pool && !idleWorkers.empty())
 			{
-				// Create array of arguments to pass to exec. "./worker" is the program to execute, arg is the command line argument
-				// to be passed to "./worker", and NULL shows it is the end of the argument list
-				char* args[] = {"./worker",  NULL};
-				// Replace current process with "./worker" process and pass iteration amount as parameter
-				execvp(args[0], args);
-				// If this prints, means exec failed
-				// Prints error message and exits
-				fprintf(stderr, "Exec failed, terminating!\n");
-				exit(1);
+				childPid = idleWorkers.back();
+				idleWorkers.pop_back();
 			}
-			else // Parent process
+			else
 			{
-				// Increment total created processes and running processes
-				total++;
-				running++;
-					
-				// Increment clock
-				incrementClock();
+				childPid = launchWorker(slot);
+				launched = true;
+			}
 
-				// Update table with new child info
-				for (int i = 0; i < 18; i++)
-				{
-					if (processTable[i].occupied == 0)
-					{
-						processTable[i].occupied = 1;
-						processTable[i].pid = childPid;
-						processTable[i].startSeconds = shm_ptr[0];
-						processTable[i].startNano = shm_ptr[1];
-						break;
-					}
-				}
-				// Calculate current time and ns and determine next spawn time
-				currTimeNs = (shm_ptr[0] * 1000000000) + shm_ptr[1];
-				nSpawnT = currTimeNs + options.interval;
+			// Increment total created processes and running processes
+			total++;
+			running++;
+			if (options.des)
+				active++;
 
-			}
+			// Increment clock. Starting a task or pooled worker costs no more than handling a message, since there is no new process
+			if (launched)
+				incrementClock();
+			else
+				addOverhead();
+			currTimeNs = clockNow(shm_ptr);
+
+			// Update table with new child info
+			processTable[slot].occupied = 1;
+			processTable[slot].pid = childPid;
+			pidMapInsert(&pidMap, childPid, slot);
+			processTable[slot].startSeconds = clockSec(currTimeNs);
+			processTable[slot].startNano = clockNano(currTimeNs);
+			processTable[slot].blockedNs = 0;
+			traceEvent(currTimeNs, TRACE_SPAWN, slot, childPid);
+			// Determine next spawn time
+			nSpawnT = currTimeNs + options.interval;
+
+			// Set the task or pooled worker going once its slot is filled in, a launched worker was told its slot already
+			if (tasks)
+				taskSpawn(slot, childPid);
+			else if (!launched)
+				startWorker(slot, childPid);
+			histRecord(&spawnWallHist, wallNow() - spawnStart);
+			if (launched)
+				break;
 		}
 
 		// Check for message received from worker without blocking
-		if (msgrcv(msqid, &rcvbuf, sizeof(msgbuffer) - sizeof(long), 1, IPC_NOWAIT) == -1)
-		{
-			if (errno == ENOMSG)
-			{
-			}
-			else 
-			{
-				perror("msgrcv");
-				exit(1);
-			}
-		}
-		else // Message received
-		{
-			int indx = -1; // Represents index of process who sent message, initialized to -1
-			// Loop through process table to find index of process from its pid
-			for (int i = 0; i < 18; i++)
-			{
-				
-				if (processTable[i].occupied == 1 && processTable[i].pid == rcvbuf.pid)
-				{
-					indx = i;
-					break;
-				}
-			}
-			
-			if (indx >= 0) // Determine if process's index was found
-			{
-				int r = rcvbuf.resId; // Represents id of resource that worker sent to be requested or released
-				if (!rcvbuf.isRelease) // Process is requesting
-				{
-					printf("Master has detected Process P%d requesting R%d at time %d:%09d\n", indx, r, shm_ptr[0], shm_ptr[1]);
-					if (logging)
-						fprintf(logfile, "Master has detected Process P%d requesting R%d at time %d:%09d\n", indx, r, shm_ptr[0], shm_ptr[1]);
-					// Determine if requested resource is available
-					if (resTable[r].available > 0)
-					{
-						// If true grant request
-						printf("Master granting P%d requesting R%d at time %d:%09d \n", indx, r, shm_ptr[0], shm_ptr[1]);
-						if (logging) 
-							fprintf(logfile, "Master granting P%d requesting R%d at time %d:%09d \n", indx, r, shm_ptr[0], shm_ptr[1]);
-						// Decrement amount available for resource in resource table
-						resTable[r].available--;
-						// Increment amount allocated to process for resource in resource table
-						resTable[r].allocation[indx]++;
-						// Increment amount of resource held by process in process table
-						processTable[indx].held[r]++;
-
-						// Prepare message to send to worker
-						buf.mtype = rcvbuf.pid; // Represents worker's pid
-						buf.granted = true; // Represents request being granted
-						// Send message to worker to notify that request is being granted
-						if (msgsnd(msqid, &buf, sizeof(msgbuffer) - sizeof(long), 0) == -1)
-						{
-							perror("msgsnd grant");
-							exit(1);
-						}
-						// Increment total immediate grants
-						immGrant++;
-					}
-					
-					else // Unable to grant request, not enough of requested resource
-					{
-						printf("Master: no instances of R%d available, P%d added to wait queue at time %d:%09d\n", r, indx, shm_ptr[0], shm_ptr[1]);
-						if (logging)
-							fprintf(logfile, "Master: no instances of R%d available, P%d added to wait queue at time %d:%09d\n", r, indx, shm_ptr[0], shm_ptr[1]);
-
-						// Increment request in resource table for process
-						resTable[r].request[indx]++;
-						// Add process to wait queue
-						resTable[r].waitQueue.push(indx);
-					}
-				}
-				else // Process is releasing
-				{
-					// Decrement amount allocated to process for resource in resource table
-					resTable[r].allocation[indx]--;
-					// Decrement amount of resource held by process in process table
-					processTable[indx].held[r]--;
-					// Increment amount of resource available in resource table
-					resTable[r].available++;
-
-					printf("Master has acknowledged Process P%d releasing R%d at time %d:%09d\n", indx, r, shm_ptr[0], shm_ptr[1]);
-					if (logging)
-						fprintf(logfile, "Master has acknowledged Process P%d releasing R%d at time %d:%09d\n", indx, r, shm_ptr[0], shm_ptr[1]);
-
-					// Prepare message to send to worker
-					buf.mtype = rcvbuf.pid; // Represents worker's pid
-					buf.granted = true; // Represents release being granted
-					// Send message to notify of release
-					if (msgsnd(msqid, &buf, sizeof(msgbuffer) - sizeof(long), 0) == -1)
-					{
-						perror("msgsnd release");
-						exit(1);
-					}
-					// List resources released
-					printf("	Resources released : R%d:1\n", r);
-					if (logging)
-						fprintf(logfile, "        Resources released : R%d:1\n", r);
+		if (!options.event && recvMsg(false))
+			handleMessage();
+		// Tasks share the CPU with oss, so let their threads run before the clock moves again instead of racing ahead of them
+		else if (!options.event && tasks)
+			sched_yield();
 
-					// Determine if any processes are waiting in wait queue
-					if (!resTable[r].waitQueue.empty())
-					{
-						// If true, get index of next waiting process and remove from queue to grant request
-						int n = resTable[r].waitQueue.front();
-						resTable[r].waitQueue.pop();
-						// Decrement amount of resource available in rcs table
-						resTable[r].available--;
-						// Increment allocation of resource for process in rcs table
-						resTable[r].allocation[n]++;
-						// Increment amount of resource held by process in process table
-						processTable[n].held[r]++;
-						// Decrement requests from process in rcs table
-						resTable[r].request[n]--;
-
-						// Prepare message to send to process
-						buf.mtype = processTable[n].pid; // Represents pid of worker
-						buf.granted = true; // Represents request being granted
-						// Send message to worker to notify that request is granted
-						if (msgsnd(msqid, &buf, sizeof(msgbuffer) - sizeof(long), 0) == -1)
-						{
-							perror("msgsnd wakeup");
-							exit(1);
-						}
-						// Increment total wait grants
-						waitGrant++;
-					}
-				}
+	}
 
-			}
-		}
+	// Out of time, so terminate every worker process still running and wait for it, leaving what it holds in the tables for the final statistics
+	if (timeUp)
+	{
+		logStat("3 seconds have passed, process(es) will now terminate.\n");
+		for (int i = 0; !tasks && i < nProc; i++)
+			if (processTable[i].occupied && processTable[i].pid > 0)
+				kill(processTable[i].pid, SIGKILL);
+		for (int i = 0; !tasks && i < nProc; i++)
+			if (processTable[i].occupied && processTable[i].pid > 0)
+				while (waitpid(processTable[i].pid, NULL, 0) == -1 && errno == EINTR);
+	}
 
+	// Stop the threads that ran tasks before anything they read is torn down, which ends the tasks left running if time is up
+	if (tasks)
+		taskPoolStop();
+
+	// Stop the pooled workers left waiting to be started
+	for (size_t i = 0; i < idleWorkers.size(); i++)
+	{
+		kill(idleWorkers[i], SIGKILL);
+		while (waitpid(idleWorkers[i], NULL, 0) == -1 && errno == EINTR);
 	}
 
 	// Calculate percentage of deadlocked processes that were killed, ensuring no division by 0
-	double dlPerc;
-        if (totDlProcs > 0)
+	double dlPerc = 0;
+	if (totDlProcs > 0)
 		dlPerc = 100.0 * dlKills / totDlProcs;
 
 
-	// Print final statistics to console
-	printf("\n----Final Statistics----\n");
-	printf("Immediate grants: %d\n", immGrant);
-	printf("Grants after waiting: %d\n", waitGrant);
-	printf("Successful terminations: %d\n", regTerms);
-	printf("Deadlock detections: %d\n", dlRuns);
-	printf("Processes killed by deadlock recovery: %d\n", dlKills);
-	printf("Percentage of deadlocked processes that were killed: %.1f%%\n", dlPerc);
-
-	// Print final statistics to logfile if necessary
-	if (logging)
+	// Print final statistics to console and logfile
+	logStat("\n----Final Statistics----\n");
+	logStat("Messages handled: %d\n", msgsHandled);
+	logStat("Immediate grants: %d\n", immGrant);
+	logStat("Grants after waiting: %d\n", waitGrant);
+	logStat("Successful terminations: %d\n", regTerms);
+	logStat("Deadlock detections: %d\n", dlRuns);
+	logStat("Processes killed by deadlock recovery: %d\n", dlKills);
+	logStat("Percentage of deadlocked processes that were killed: %.1f%%\n", dlPerc);
+	if (options.avoid)
+		logStat("Requests made to wait because granting was unsafe: %d\n", unsafeWaits);
+	printLatency("Wait from queued to granted (simulated)", &waitSimHist, 1e6, "ms");
+	printLatency("Wait from queued to granted (real)", &waitWallHist, 1e3, "us");
+	printLatency("Time blocked per process (simulated)", &blockedHist, 1e6, "ms");
+	printLatency("Time to start a worker (real)", &spawnWallHist, 1e3, "us");
+
+	// Print each resource's longest wait queue and how much of it was held over the run
+	uint64_t endNs = clockNow(shm_ptr);
+	logStat("Resource\tMaxQueue\tMaxInUse\tUtilization\n");
+	for (int i = 0; i < nRes; i++)
 	{
-		fprintf(logfile, "\n----Final Statistics----\n");
-		fprintf(logfile, "Immediate grants: %d\n", immGrant);
-		fprintf(logfile, "Grants after waiting: %d\n", waitGrant);
-		fprintf(logfile, "Successful terminations: %d\n", regTerms);
-		fprintf(logfile, "Deadlock detections: %d\n", dlRuns);
-		fprintf(logfile, "Processes killed by deadlock recovery: %d\n", dlKills);
-		fprintf(logfile, "Percentage of deadlocked processes that were killed: %.1f%%\n", dlPerc);
+		trackUsage(i);
+		double util = endNs == 0 ? 0 : 100.0 * resTable[i].busyArea / ((double)endNs * resTable[i].total);
+		logStat("R%d\t\t%d\t\t%d/%d\t\t%.1f%%\n", i, resTable[i].maxWaitLen, resTable[i].maxInUse, resTable[i].total, util);
 	}
 
+	// Publish final counters and remove live statistics, while the clock is still attached
+	removeStats(total);
+
 	// Detach from shared memory and remove it
 	if(shmdt(shm_ptr) == -1)
 	{
@@ -1065,8 +2586,12 @@ int main(int argc, char* argv[])
 		perror("msgctl failed");
 		exit(1);
 	}
+	// Remove the shared memory transport if used
+	if (ring != NULL)
+		removeRing();
 
-	return 0;
+	// A run cut off by the time limit did not finish its processes
+	return timeUp ? EXIT_FAILURE : EXIT_SUCCESS;
 
 }
 
@@ -0,0 +1,432 @@
+// Operating Systems Project 5
+// Description: Benchmark driver for oss, run by make bench. Runs oss over every combination of the -n, -s, and -i values given,
+// repeating each combination, and reads the final statistics oss prints. Records real run time, messages and grants per real second,
+// deadlock detections, and kills for each run, and writes the median and variance of each over the repeats as JSON and CSV. If a
+// baseline CSV from an earlier run is given, each combination's median run time and message rate are compared against it, and any that
+// got worse by more than both the threshold and the noise the two runs' variances allow are flagged as regressions, making the exit
+// status 1. Runs cut off by oss's 3 second limit are left out of the samples, so each combination's completion rate is compared too,
+// and a drop beyond the threshold and the noise expected from that many repeats is also a regression.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "clock.h"
+
+using namespace std;
+
+// Metrics recorded for each run, in the order they are written
+#define M_WALL_MS 0 // Real time oss took
+#define M_MSGS_PER_SEC 1 // Messages oss handled per real second
+#define M_GRANTS_PER_SEC 2 // Requests granted, at once or after waiting, per real second
+#define M_DL_RUNS 3 // Deadlocks detected
+#define M_DL_KILLS 4 // Processes killed by recovery
+#define METRICS 5
+
+const char* metricNames[METRICS] = {"wall_ms", "msgs_per_sec", "grants_per_sec", "dl_runs", "dl_kills"};
+
+// Structure for one combination of options and its runs
+typedef struct
+{
+	int n; // -n
+	int s; // -s
+	int i; // -i
+	int repeats; // Runs made
+	int completed; // Runs that finished and printed final statistics, rather than being cut off by oss's 3 second limit
+	vector<double> samples[METRICS]; // Each metric from each completed run
+	double median[METRICS];
+	double variance[METRICS];
+} Point;
+
+void print_usage(const char * app)
+{
+	fprintf(stdout, "usage: %s [-h] [-n list] [-s list] [-i list] [-r repeats] [-x oss_args] [-o prefix] [-b baseline] [-t percent] [-k sigmas]\n", app);
+	fprintf(stdout, "      lists are comma separated values for oss's -n, -s, and -i, every combination is run (default 20 / 5,10 / 0,10)\n");
+	fprintf(stdout, "      repeats is how many times each combination is run (default 10)\n");
+	fprintf(stdout, "      oss_args are more options passed to every oss run, such as \"-d -g\"\n");
+	fprintf(stdout, "      prefix names the results, written to prefix.json and prefix.csv (default bench)\n");
+	fprintf(stdout, "      baseline is a CSV from an earlier run to compare against, skipped if it does not exist\n");
+	fprintf(stdout, "      percent is how much worse than the baseline a median can get before it is a regression (default 10)\n");
+	fprintf(stdout, "      sigmas is how many standard deviations of noise, from both runs' variances, a change must also exceed (default 2)\n");
+}
+
+// Function to parse a comma separated list of numbers into out. Returns false if any entry is not a number
+bool parseList(const char* arg, vector<int>& out)
+{
+	out.clear();
+	string item;
+	for (const char* c = arg; ; c++)
+	{
+		if (*c == ',' || *c == '\0')
+		{
+			if (item.empty())
+				return false;
+			out.push_back(atoi(item.c_str()));
+			item.clear();
+			if (*c == '\0')
+				return true;
+		}
+		else if (isdigit(*c))
+			item += *c;
+		else
+			return false;
+	}
+}
+
+// Function to get the real time in ns
+uint64_t wallNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+// Function to run oss once with the options of p and extra, adding its metrics to p if it completes. oss's output goes to a temporary
+// file rather than a pipe, so how fast it is read back does not slow oss down
+void runOnce(Point& p, const string& extra)
+{
+	char outPath[] = "/tmp/ossbenchXXXXXX";
+	int fd = mkstemp(outPath);
+	if (fd < 0)
+	{
+		perror("mkstemp");
+		exit(1);
+	}
+
+	string cmd = "exec ./oss -n " + to_string(p.n) + " -s " + to_string(p.s) + " -i " + to_string(p.i) + " " + extra;
+	uint64_t start = wallNow();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		dup2(fd, STDOUT_FILENO);
+		execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)NULL);
+		fprintf(stderr, "Exec failed, terminating!\n");
+		exit(1);
+	}
+	int status = 0;
+	while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+	double secs = (wallNow() - start) / (double)NS_PER_SEC;
+
+	// Read the final statistics, which are the last lines oss prints
+	FILE* out = fdopen(fd, "r");
+	rewind(out);
+	char line[1024];
+	bool final = false;
+	long msgs = -1, imm = -1, waited = -1, runs = -1, kills = -1;
+	while (fgets(line, sizeof(line), out) != NULL)
+	{
+		if (strncmp(line, "----Final Statistics----", 24) == 0)
+			final = true;
+		else if (final)
+		{
+			sscanf(line, "Messages handled: %ld", &msgs);
+			sscanf(line, "Immediate grants: %ld", &imm);
+			sscanf(line, "Grants after waiting: %ld", &waited);
+			sscanf(line, "Deadlock detections: %ld", &runs);
+			sscanf(line, "Processes killed by deadlock recovery: %ld", &kills);
+		}
+	}
+	fclose(out);
+	unlink(outPath);
+
+	// oss still prints final statistics when cut off by its time limit, but exits with failure
+	bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (!ok || !final || msgs < 0 || imm < 0 || waited < 0 || runs < 0 || kills < 0)
+	{
+		fprintf(stderr, "   run did not complete, left out\n");
+		return;
+	}
+	p.completed++;
+	p.samples[M_WALL_MS].push_back(secs * 1000);
+	p.samples[M_MSGS_PER_SEC].push_back(msgs / secs);
+	p.samples[M_GRANTS_PER_SEC].push_back((imm + waited) / secs);
+	p.samples[M_DL_RUNS].push_back(runs);
+	p.samples[M_DL_KILLS].push_back(kills);
+}
+
+// Function to fill in the median and sample variance of each metric of p
+void summarize(Point& p)
+{
+	for (int m = 0; m < METRICS; m++)
+	{
+		vector<double> v = p.samples[m];
+		p.median[m] = p.variance[m] = 0;
+		if (v.empty())
+			continue;
+		sort(v.begin(), v.end());
+		size_t k = v.size();
+		p.median[m] = k % 2 ? v[k / 2] : (v[k / 2 - 1] + v[k / 2]) / 2;
+		double mean = 0;
+		for (double x : v)
+			mean += x;
+		mean /= k;
+		for (double x : v)
+			p.variance[m] += (x - mean) * (x - mean);
+		p.variance[m] = k > 1 ? p.variance[m] / (k - 1) : 0;
+	}
+}
+
+// Function to escape a string for a JSON string literal
+string jsonEscape(const string& in)
+{
+	string out;
+	for (char ch : in)
+	{
+		if (ch == '"' || ch == '\\')
+		{
+			out += '\\';
+			out += ch;
+		}
+		else if ((unsigned char)ch < 0x20) // Control characters cannot appear raw
+		{
+			char hex[8];
+			snprintf(hex, sizeof(hex), "\\u%04x", ch);
+			out += hex;
+		}
+		else
+			out += ch;
+	}
+	return out;
+}
+
+// Function to write every point as JSON, with each run's samples along with the median and variance
+bool writeJson(const string& path, const vector<Point>& points, const string& extra)
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL)
+		return false;
+	fprintf(f, "{\"oss_args\":\"%s\",\"points\":[\n", jsonEscape(extra).c_str());
+	for (size_t k = 0; k < points.size(); k++)
+	{
+		const Point& p = points[k];
+		fprintf(f, "  {\"n\":%d,\"s\":%d,\"i\":%d,\"repeats\":%d,\"completed\":%d,\"completion_rate\":%.3f", p.n, p.s, p.i, p.repeats,
+			p.completed, (double)p.completed / p.repeats);
+		for (int m = 0; m < METRICS; m++)
+		{
+			fprintf(f, ",\"%s\":{\"median\":%.3f,\"variance\":%.3f,\"samples\":[", metricNames[m], p.median[m], p.variance[m]);
+			for (size_t j = 0; j < p.samples[m].size(); j++)
+				fprintf(f, "%s%.3f", j > 0 ? "," : "", p.samples[m][j]);
+			fprintf(f, "]}");
+		}
+		fprintf(f, "}%s\n", k + 1 < points.size() ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	fclose(f);
+	return true;
+}
+
+// Function to write every point as a CSV line of its options and each metric's median and variance. The options oss was run with
+// go in a comment line first, since they are the same for every point
+bool writeCsv(const string& path, const vector<Point>& points, const string& extra)
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL)
+		return false;
+	fprintf(f, "# oss_args: %s\n", extra.c_str());
+	fprintf(f, "n,s,i,repeats,completed");
+	for (int m = 0; m < METRICS; m++)
+		fprintf(f, ",%s_median,%s_variance", metricNames[m], metricNames[m]);
+	fprintf(f, "\n");
+	for (const Point& p : points)
+	{
+		fprintf(f, "%d,%d,%d,%d,%d", p.n, p.s, p.i, p.repeats, p.completed);
+		for (int m = 0; m < METRICS; m++)
+			fprintf(f, ",%.3f,%.3f", p.median[m], p.variance[m]);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return true;
+}
+
+// Function to compare each point against the matching line of a baseline CSV. A point regresses if its median run time went up, or its
+// median message rate went down, by more than percent and by more than sigmas standard deviations of noise, taken from the variance of
+// the baseline and of this run together. It also regresses if its completion rate went down by more than percent points and by more
+// than sigmas standard deviations of the difference of two binomial rates over that many repeats, since runs cut off by the time limit
+// are not in the medians. Returns the amount of regressions, printing each one
+int compareBaseline(const string& path, const vector<Point>& points, const string& extra, double percent, double sigmas)
+{
+	FILE* f = fopen(path.c_str(), "r");
+	if (f == NULL)
+	{
+		printf("No baseline at %s, skipping comparison\n", path.c_str());
+		return 0;
+	}
+
+	int regressions = 0;
+	bool hasRepeats = false; // Baselines from before the repeats column have no completion rate to compare
+	char line[2048];
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		// Warn if the baseline ran oss with other options, then skip the comment and heading lines
+		if (strncmp(line, "# oss_args: ", 12) == 0)
+		{
+			line[strcspn(line, "\n")] = '\0';
+			if (strcmp(line + 12, extra.c_str()) != 0)
+				printf("Warning: baseline ran oss with \"%s\", this run used \"%s\"\n", line + 12, extra.c_str());
+		}
+		if (strncmp(line, "n,s,i,", 6) == 0)
+			hasRepeats = strncmp(line + 6, "repeats,", 8) == 0;
+		if (!isdigit(line[0]))
+			continue;
+		int n, s, i, repeats = 0, completed;
+		double values[2 * METRICS];
+		char* c = line;
+		int columns = hasRepeats ? 5 : 4;
+		if ((hasRepeats ? sscanf(c, "%d,%d,%d,%d,%d", &n, &s, &i, &repeats, &completed) : sscanf(c, "%d,%d,%d,%d", &n, &s, &i, &completed))
+			!= columns)
+			continue;
+		for (int k = 0; k < columns; k++)
+			c = strchr(c, ',') + 1;
+		for (int k = 0; k < 2 * METRICS; k++)
+		{
+			values[k] = strtod(c, &c);
+			if (*c == ',')
+				c++;
+		}
+
+		for (const Point& p : points)
+		{
+			if (p.n != n || p.s != s || p.i != i)
+				continue;
+
+			// Completion rates in percent, with the noise from the rate of both runs pooled
+			if (repeats > 0)
+			{
+				double baseRate = 100.0 * completed / repeats;
+				double rate = 100.0 * p.completed / p.repeats;
+				double pooled = (double)(completed + p.completed) / (repeats + p.repeats);
+				double rateNoise = 100.0 * sigmas * sqrt(pooled * (1 - pooled) * (1.0 / repeats + 1.0 / p.repeats));
+				bool dropped = baseRate - rate > percent && baseRate - rate > rateNoise;
+				printf("%s -n %d -s %d -i %d: completed %.0f%% vs %.0f%% (%+.0f points, noise %.0f points)\n", dropped ? "REGRESSION" : "ok        ",
+					n, s, i, rate, baseRate, rate - baseRate, rateNoise);
+				if (dropped)
+					regressions++;
+			}
+
+			if (p.completed == 0 || completed == 0)
+				continue;
+			double baseWall = values[2 * M_WALL_MS];
+			double baseMsgs = values[2 * M_MSGS_PER_SEC];
+			double wallChange = 100.0 * (p.median[M_WALL_MS] - baseWall) / baseWall;
+			double msgsChange = 100.0 * (p.median[M_MSGS_PER_SEC] - baseMsgs) / baseMsgs;
+			// Noise each change must exceed, as a percent of the baseline like the change
+			double wallNoise = 100.0 * sigmas * sqrt(values[2 * M_WALL_MS + 1] + p.variance[M_WALL_MS]) / baseWall;
+			double msgsNoise = 100.0 * sigmas * sqrt(values[2 * M_MSGS_PER_SEC + 1] + p.variance[M_MSGS_PER_SEC]) / baseMsgs;
+			bool regressed = (wallChange > percent && wallChange > wallNoise) || (-msgsChange > percent && -msgsChange > msgsNoise);
+			printf("%s -n %d -s %d -i %d: wall %.1fms vs %.1fms (%+.1f%%, noise %.1f%%), msgs/s %.0f vs %.0f (%+.1f%%, noise %.1f%%)\n",
+				regressed ? "REGRESSION" : "ok        ", n, s, i, p.median[M_WALL_MS], baseWall, wallChange, wallNoise, p.median[M_MSGS_PER_SEC],
+				baseMsgs, msgsChange, msgsNoise);
+			if (regressed)
+				regressions++;
+		}
+	}
+	fclose(f);
+	return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<int> ns = {20}, ss = {5, 10}, is = {0, 10};
+	int repeats = 10;
+	string extra = "";
+	string prefix = "bench";
+	string baseline = "";
+	double percent = 10;
+	double sigmas = 2;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hn:s:i:r:x:o:b:t:k:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': // Help
+				print_usage(argv[0]);
+				return EXIT_SUCCESS;
+			case 'n': // Lists of option values
+			case 's':
+			case 'i':
+				if (!parseList(optarg, opt == 'n' ? ns : opt == 's' ? ss : is))
+				{
+					fprintf(stderr, "Error! %s is not a valid list of numbers.\n", optarg);
+					print_usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'r': // Repeats of each combination
+				repeats = atoi(optarg);
+				break;
+			case 'x': // More options for oss
+				extra = optarg;
+				break;
+			case 'o': // Results prefix
+				prefix = optarg;
+				break;
+			case 'b': // Baseline to compare against
+				baseline = optarg;
+				break;
+			case 't': // Regression threshold
+				percent = atof(optarg);
+				break;
+			case 'k': // Noise margin
+				sigmas = atof(optarg);
+				break;
+			default:
+				fprintf(stderr, "Error! Invalid option %c.\n", optopt);
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (repeats < 1 || percent <= 0 || sigmas < 0)
+	{
+		fprintf(stderr, "Error! Repeats and percent must be above 0, and sigmas cannot be below 0.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Run every combination, repeats times each
+	vector<Point> points;
+	for (int n : ns)
+	{
+		for (int s : ss)
+		{
+			for (int i : is)
+			{
+				Point p;
+				p.n = n;
+				p.s = s;
+				p.i = i;
+				p.repeats = repeats;
+				p.completed = 0;
+				printf("oss -n %d -s %d -i %d%s%s: ", n, s, i, extra.empty() ? "" : " ", extra.c_str());
+				fflush(stdout);
+				for (int r = 0; r < repeats; r++)
+					runOnce(p, extra);
+				summarize(p);
+				printf("%d/%d completed, median %.1fms, %.0f msgs/s, %.0f grants/s\n", p.completed, repeats, p.median[M_WALL_MS],
+					p.median[M_MSGS_PER_SEC], p.median[M_GRANTS_PER_SEC]);
+				points.push_back(p);
+			}
+		}
+	}
+
+	if (!writeJson(prefix + ".json", points, extra) || !writeCsv(prefix + ".csv", points, extra))
+	{
+		perror("Writing results failed");
+		return EXIT_FAILURE;
+	}
+	printf("Results written to %s.json and %s.csv\n", prefix.c_str(), prefix.c_str());
+
+	if (!baseline.empty() && compareBaseline(baseline, points, extra, percent, sigmas) > 0)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+// Operating Systems Project 5
+// Description: Watches a running oss from outside it. Attaches read only to the live statistics segment oss publishes and prints a
+// line every interval, like vmstat: simulated time, workers running and launched, grants per real second since the last line, the
+// requests held back as unsafe, the deadlock counters, and each resource's available instances and wait queue length. Stops once oss
+// is done or gone. Run from the directory oss was started in, since the segment is keyed on its msgq.txt.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <vector>
+
+#include "clock.h"
+#include "stats.h"
+
+#define HEADER_EVERY 20 // Lines printed between repeats of the column headings
+
+using namespace std;
+
+void print_usage(const char * app)
+{
+	fprintf(stdout, "usage: %s [-h] [-i interval_ms] [-c count]\n", app);
+	fprintf(stdout, "      interval is the real time between lines in milliseconds (default 1000)\n");
+	fprintf(stdout, "      count is the amount of lines to print before stopping, 0 to keep going until oss is done (default 0)\n");
+}
+
+// Function to get the real time in ns
+uint64_t wallNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+// Function to print the column headings
+void printHeader(int nRes)
+{
+	printf("%13s %7s %8s %9s %9s %6s %6s %7s %6s %6s |", "time", "running", "launched", "imm/s", "waited/s", "unsafe", "terms", "dlprocs",
+		"dlruns", "kills");
+	char label[32]; // Room for "R", any int, and " av/q"
+	for (int r = 0; r < nRes; r++)
+	{
+		snprintf(label, sizeof(label), "R%d av/q", r);
+		printf(" %9s", label);
+	}
+	printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+	long long interval = 1000; // Milliseconds between lines
+	long long count = 0; // Lines to print, 0 for no limit
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hi:c:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': // Help
+				print_usage(argv[0]);
+				return EXIT_SUCCESS;
+			case 'i': // Interval between lines
+			case 'c': // Amount of lines
+				// Loop to ensure all characters in argument are digits
+				for (int i = 0; optarg[i] != '\0'; i++)
+				{
+					if (!isdigit(optarg[i]))
+					{
+						fprintf(stderr, "Error! %s is not a valid number.\n", optarg);
+						print_usage(argv[0]);
+						return EXIT_FAILURE;
+					}
+				}
+				if (opt == 'i')
+					interval = atoll(optarg);
+				else
+					count = atoll(optarg);
+				break;
+			default:
+				fprintf(stderr, "Error! Invalid option %c.\n", optopt);
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (interval < 1)
+	{
+		fprintf(stderr, "Error! Interval must be at least 1 millisecond.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Attach to the segment oss created, read only so nothing here can disturb it
+	const int stats_key = ftok("msgq.txt", STATS_KEY_ID);
+	int stats_id = stats_key == -1 ? -1 : shmget(stats_key, 0, 0);
+	if (stats_id < 0)
+	{
+		fprintf(stderr, "Error! No oss is running from this directory.\n");
+		return EXIT_FAILURE;
+	}
+	Stats* stats = (Stats*)shmat(stats_id, 0, SHM_RDONLY);
+	if (stats == (Stats*)-1)
+	{
+		perror("shmat");
+		return EXIT_FAILURE;
+	}
+	if (stats->version != STATS_VERSION)
+	{
+		fprintf(stderr, "Error! oss publishes statistics version %u, this ossstat reads version %d.\n", stats->version, STATS_VERSION);
+		return EXIT_FAILURE;
+	}
+
+	int nRes = stats->nRes;
+	int64_t counters[STAT_COUNTERS];
+	int64_t last[STAT_COUNTERS]; // Counters at the previous line, for rates
+	vector<int32_t> available(nRes);
+	vector<int32_t> waitLen(nRes);
+
+	statsRead(stats, last, available.data(), waitLen.data());
+	uint64_t lastWall = wallNow();
+	for (long long line = 0; count == 0 || line < count; line++)
+	{
+		struct timespec pause = {(time_t)(interval / 1000), (long)(interval % 1000) * 1000000};
+		while (nanosleep(&pause, &pause) == -1 && errno == EINTR);
+
+		// Stop after the last line once oss is done, or right away if it is gone without saying so
+		bool done = stats->done.load(memory_order_acquire);
+		if (!done && kill(stats->ossPid, 0) == -1 && errno == ESRCH)
+		{
+			fprintf(stderr, "oss exited without publishing final statistics.\n");
+			break;
+		}
+
+		statsRead(stats, counters, available.data(), waitLen.data());
+		uint64_t nowWall = wallNow();
+		double secs = (nowWall - lastWall) / (double)NS_PER_SEC;
+
+		if (line % HEADER_EVERY == 0)
+			printHeader(nRes);
+		printf("%3u.%09u %7lld %8lld %9.0f %9.0f %6lld %6lld %7lld %6lld %6lld |", clockSec(counters[STAT_CLOCK_NS]), clockNano(counters[STAT_CLOCK_NS]),
+			(long long)counters[STAT_RUNNING], (long long)counters[STAT_LAUNCHED],
+			(counters[STAT_IMM_GRANTS] - last[STAT_IMM_GRANTS]) / secs, (counters[STAT_WAIT_GRANTS] - last[STAT_WAIT_GRANTS]) / secs,
+			(long long)counters[STAT_UNSAFE_WAITS], (long long)counters[STAT_TERMS], (long long)counters[STAT_DL_PROCS],
+			(long long)counters[STAT_DL_RUNS], (long long)counters[STAT_DL_KILLS]);
+		for (int r = 0; r < nRes; r++)
+			printf(" %4d/%-4d", available[r], waitLen[r]);
+		printf("\n");
+		fflush(stdout);
+
+		memcpy(last, counters, sizeof(last));
+		lastWall = nowWall;
+		if (done)
+			break;
+	}
+
+	shmdt(stats);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+// Operating Systems Project 5
+// Description: Reads a binary event trace written by oss -o and prints it to stdout as CSV, one line per event, or as Chrome trace
+// event JSON that can be opened in chrome://tracing or Perfetto. In the JSON each worker is its own thread, named by its slot, with a
+// span for its lifetime and a span for each request from when it was queued until it was granted. Every other event is a mark on
+// the worker's thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+
+#include "trace.h"
+
+// Names of each kind of event, in TRACE_ order
+const char* kindNames[TRACE_KINDS] = {"spawn", "request", "grant", "wait", "unsafe", "deny", "wake", "release", "claim", "deadlock", "kill", "exit"};
+
+void print_usage(const char * app)
+{
+	fprintf(stdout, "usage: %s [-h] [-c | -j] trace\n", app);
+	fprintf(stdout, "      trace is a file written by oss -o\n");
+	fprintf(stdout, "      selecting c will print the trace as CSV (default)\n");
+	fprintf(stdout, "      selecting j will print the trace as Chrome trace event JSON\n");
+}
+
+// Function to get the name of an event kind, including kinds written by a newer oss
+const char* kindName(int kind)
+{
+	return kind < TRACE_KINDS ? kindNames[kind] : "unknown";
+}
+
+// Function to print every record as a CSV line
+void printCsv(const TraceRecord* recs, uint64_t n)
+{
+	printf("ns,kind,slot,pid,resource,count,seq\n");
+	for (uint64_t i = 0; i < n; i++)
+	{
+		const TraceRecord* r = &recs[i];
+		printf("%llu,%s,%d,%d,%d,%d,%u\n", (unsigned long long)r->ns, kindName(r->kind), r->slot, r->pid, r->res, r->count, r->seq);
+	}
+}
+
+// Function to print a Chrome trace event timestamp, which is in microseconds
+void printTs(uint64_t ns)
+{
+	printf("%llu.%03llu", (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+}
+
+// Function to print every record as Chrome trace event JSON
+void printJson(const TraceRecord* recs, uint64_t n)
+{
+	std::map<int32_t, uint64_t> spawned; // Spawn time of each worker still running
+	uint64_t last = n > 0 ? recs[n - 1].ns : 0; // Workers still running at the end of the trace are shown running until here
+	bool first = true; // Represents if first event has been printed. Used to determine when to print commas
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (uint64_t i = 0; i < n; i++)
+	{
+		const TraceRecord* r = &recs[i];
+		fputs(first ? "" : ",\n", stdout);
+		first = false;
+
+		switch (r->kind)
+		{
+			case TRACE_SPAWN: // Name the worker's thread after its slot and start its lifetime
+				spawned[r->pid] = r->ns;
+				printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"P%d (pid %d)\"}}", r->pid, r->slot, r->pid);
+				break;
+
+			case TRACE_EXIT: // Worker's lifetime ends, whether it exited or was killed
+			case TRACE_KILL:
+			{
+				auto it = spawned.find(r->pid);
+				if (it != spawned.end())
+				{
+					printf("{\"name\":\"P%d\",\"cat\":\"process\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":", r->slot, r->pid);
+					printTs(it->second);
+					printf(",\"dur\":");
+					printTs(r->ns - it->second);
+					printf("},\n");
+					spawned.erase(it);
+				}
+				printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":", kindName(r->kind), r->pid);
+				printTs(r->ns);
+				printf("}");
+				break;
+			}
+
+			case TRACE_WAIT: // Request was queued, a span starts until it is granted
+			case TRACE_UNSAFE:
+			case TRACE_WAKE:
+				if (r->kind == TRACE_WAKE)
+					printf("{\"name\":\"wait\",\"cat\":\"wait\",\"ph\":\"e\"");
+				else if (r->res >= 0)
+					printf("{\"name\":\"wait\",\"cat\":\"wait\",\"ph\":\"b\",\"args\":{\"short\":\"R%d\",\"seq\":%u}", r->res, r->seq);
+				else
+					printf("{\"name\":\"wait\",\"cat\":\"wait\",\"ph\":\"b\",\"args\":{\"short\":\"unsafe\",\"seq\":%u}", r->seq);
+				printf(",\"id\":\"%d.%u\",\"pid\":1,\"tid\":%d,\"ts\":", r->pid, r->seq, r->pid);
+				printTs(r->ns);
+				printf("}");
+				break;
+
+			default: // Everything else is a mark on the worker's thread
+				printf("{\"name\":\"%s", kindName(r->kind));
+				if (r->res >= 0)
+					printf(" R%d:%d", r->res, r->count);
+				printf("\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":", r->pid);
+				printTs(r->ns);
+				printf(",\"args\":{\"seq\":%u}}", r->seq);
+				break;
+		}
+	}
+
+	// Close the lifetimes of workers still running when the trace ended
+	for (auto& w : spawned)
+	{
+		fputs(first ? "" : ",\n", stdout);
+		first = false;
+		printf("{\"name\":\"running\",\"cat\":\"process\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":", w.first);
+		printTs(w.second);
+		printf(",\"dur\":");
+		printTs(last - w.second);
+		printf("}");
+	}
+	printf("\n]}\n");
+}
+
+int main(int argc, char* argv[])
+{
+	bool json = false; // Represents if output is JSON instead of CSV
+	int opt;
+	while ((opt = getopt(argc, argv, "hcj")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': // Help
+				print_usage(argv[0]);
+				return EXIT_SUCCESS;
+			case 'c': // CSV output
+				json = false;
+				break;
+			case 'j': // Chrome trace event JSON output
+				json = true;
+				break;
+			default:
+				fprintf(stderr, "Error! Invalid option %c.\n", optopt);
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "Error! One trace file is required.\n");
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Map the whole trace file
+	const char* path = argv[optind];
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) == -1)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	if ((size_t)st.st_size < sizeof(TraceHeader))
+	{
+		fprintf(stderr, "Error! %s is too short to be a trace.\n", path);
+		return EXIT_FAILURE;
+	}
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	const TraceHeader* header = (const TraceHeader*)map;
+	if (header->magic != TRACE_MAGIC || header->version != TRACE_VERSION || header->recordSize != sizeof(TraceRecord))
+	{
+		fprintf(stderr, "Error! %s is not a version %d oss trace.\n", path, TRACE_VERSION);
+		return EXIT_FAILURE;
+	}
+	const TraceRecord* recs = (const TraceRecord*)(header + 1);
+	uint64_t room = (st.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+	uint64_t n = header->count;
+
+	// If oss was killed before it could write the count, read records up to the first one never written, which has no pid
+	if (n == 0 || n > room)
+	{
+		n = 0;
+		while (n < room && recs[n].pid != 0)
+			n++;
+		if (n > 0)
+			fprintf(stderr, "Warning: %s was not closed, read %llu records.\n", path, (unsigned long long)n);
+	}
+
+	if (json)
+		printJson(recs, n);
+	else
+		printCsv(recs, n);
+
+	munmap(map, st.st_size);
+	close(fd);
+	return EXIT_SUCCESS;
+}
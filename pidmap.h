@@ -0,0 +1,90 @@
+// Operating Systems Project 5
+// Description: Index from a worker's pid to its process table slot, used by oss to find the sender of each message and the slot of
+// each child it reaps without scanning the table. It is an open addressing hash table with linear probing, sized at startup to at
+// least twice the process table so probes stay short. Removal shifts later entries back into the gap, so there are no tombstones
+// and lookups never slow down as workers come and go.
+
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Structure for the pid index
+typedef struct
+{
+	pid_t* pids; // Pid in each bucket, 0 if empty
+	int* slots; // Process table slot of the pid in each bucket
+	uint32_t mask; // Amount of buckets - 1, buckets is a power of 2
+	int shift; // Bits to shift a hashed pid right by to get a bucket
+} PidMap;
+
+// Function to set up an empty index with room for n workers
+inline void pidMapInit(PidMap* m, int n)
+{
+	uint32_t buckets = 16;
+	int bits = 4;
+	while (buckets < 2 * (uint32_t)n)
+	{
+		buckets *= 2;
+		bits++;
+	}
+	m->pids = new pid_t[buckets]();
+	m->slots = new int[buckets];
+	m->mask = buckets - 1;
+	m->shift = 32 - bits;
+}
+
+// Function to get the bucket a pid hashes to. Multiplying by 2^32 / golden ratio and keeping the top bits spreads out nearby pids
+inline uint32_t pidBucket(const PidMap* m, pid_t pid)
+{
+	return ((uint32_t)pid * 2654435769u) >> m->shift;
+}
+
+// Function to add pid in slot to the index
+inline void pidMapInsert(PidMap* m, pid_t pid, int slot)
+{
+	uint32_t b = pidBucket(m, pid);
+	while (m->pids[b] != 0 && m->pids[b] != pid)
+		b = (b + 1) & m->mask;
+	m->pids[b] = pid;
+	m->slots[b] = slot;
+}
+
+// Function to find the slot of pid, returns -1 if pid is not in the index
+inline int pidMapFind(const PidMap* m, pid_t pid)
+{
+	for (uint32_t b = pidBucket(m, pid); m->pids[b] != 0; b = (b + 1) & m->mask)
+		if (m->pids[b] == pid)
+			return m->slots[b];
+	return -1;
+}
+
+// Function to remove pid from the index. Entries after it in the same run are moved back if their probe passed through its bucket,
+// so every remaining pid can still be found from its home bucket
+inline void pidMapErase(PidMap* m, pid_t pid)
+{
+	uint32_t b = pidBucket(m, pid);
+	while (m->pids[b] != pid)
+	{
+		if (m->pids[b] == 0)
+			return;
+		b = (b + 1) & m->mask;
+	}
+
+	uint32_t gap = b;
+	for (uint32_t next = (gap + 1) & m->mask; m->pids[next] != 0; next = (next + 1) & m->mask)
+	{
+		// Move entry into the gap unless its home bucket lies after the gap, between the gap and where it sits now
+		uint32_t home = pidBucket(m, m->pids[next]);
+		if (((next - home) & m->mask) >= ((next - gap) & m->mask))
+		{
+			m->pids[gap] = m->pids[next];
+			m->slots[gap] = m->slots[next];
+			gap = next;
+		}
+	}
+	m->pids[gap] = 0;
+}
+
+#endif
@@ -0,0 +1,96 @@
+// Operating Systems Project 5
+// Description: Live statistics segment oss publishes its counters and each resource's available instances and wait queue length to,
+// so ossstat can watch a run while it goes. oss copies its counters in every STATS_PERIOD_NS of real time from its main loop rather
+// than as they change, so handling messages costs nothing more. The segment is guarded by a sequence lock: oss makes seq odd while
+// it writes and even again once done, and a reader copies everything, then retries if seq was odd or changed while it copied. Every
+// field is atomic so the copy is never a data race, only possibly torn, which the retry catches.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATS_VERSION 1 // Changed whenever the layout changes, so an old ossstat refuses a newer segment
+#define STATS_KEY_ID 3 // ftok id of the segment, on msgq.txt like the message queue and transport
+#define STATS_PERIOD_NS 10000000 // Real time between publishes
+
+// Counters published, in the order they are stored
+#define STAT_CLOCK_NS 0 // Simulated time
+#define STAT_RUNNING 1 // Workers running
+#define STAT_LAUNCHED 2 // Workers launched
+#define STAT_IMM_GRANTS 3 // Requests granted as soon as they arrived
+#define STAT_WAIT_GRANTS 4 // Requests granted after waiting
+#define STAT_TERMS 5 // Workers that exited on their own
+#define STAT_DL_RUNS 6 // Deadlocks found
+#define STAT_DL_KILLS 7 // Workers killed by deadlock recovery
+#define STAT_DL_PROCS 8 // Workers found deadlocked
+#define STAT_UNSAFE_WAITS 9 // Requests made to wait because granting was unsafe
+#define STAT_COUNTERS 10
+
+// Structure for one resource's published state
+typedef struct
+{
+	std::atomic<int32_t> available; // Instances available
+	std::atomic<int32_t> waitLen; // Processes in its wait queue
+} StatsRes;
+
+// Structure for the start of the segment, followed by nRes StatsRes
+typedef struct
+{
+	uint32_t version; // STATS_VERSION
+	int32_t nRes; // Amount of resources following
+	pid_t ossPid; // oss that publishes to the segment
+	std::atomic<uint32_t> done; // Set once oss has published for the last time
+	alignas(64) std::atomic<uint32_t> seq; // Odd while oss is writing
+	std::atomic<int64_t> counters[STAT_COUNTERS]; // STAT_ counters
+} Stats;
+
+// Function to get the bytes a segment for nRes resources takes
+inline size_t statsSize(int nRes)
+{
+	return sizeof(Stats) + (size_t)nRes * sizeof(StatsRes);
+}
+
+// Function to get the published state of resource r
+inline StatsRes* statsRes(Stats* s, int r)
+{
+	return (StatsRes*)(s + 1) + r;
+}
+
+// Function to start a publish, readers retry until statsEnd
+inline void statsBegin(Stats* s)
+{
+	s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+// Function to end a publish
+inline void statsEnd(Stats* s)
+{
+	s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Function to copy a consistent set of counters and nRes resources' state out of the segment, retrying while oss is writing
+inline void statsRead(Stats* s, int64_t counters[STAT_COUNTERS], int32_t available[], int32_t waitLen[])
+{
+	while (true)
+	{
+		uint32_t before = s->seq.load(std::memory_order_acquire);
+		if (before & 1)
+			continue;
+		for (int i = 0; i < STAT_COUNTERS; i++)
+			counters[i] = s->counters[i].load(std::memory_order_relaxed);
+		for (int r = 0; r < s->nRes; r++)
+		{
+			available[r] = statsRes(s, r)->available.load(std::memory_order_relaxed);
+			waitLen[r] = statsRes(s, r)->waitLen.load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s->seq.load(std::memory_order_relaxed) == before)
+			return;
+	}
+}
+
+#endif
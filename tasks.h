@@ -0,0 +1,232 @@
+// Operating Systems Project 5
+// Description: Runs workers as tasks inside oss instead of as processes, so a run can have thousands of them at once without a fork and
+// exec for each. Every task is a Client from client.h, the same logic a worker process runs. A few threads each own a range of the
+// process table slots and keep passing over them, taking any replies waiting in a slot's mailbox and then stepping its client until it
+// waits again. Tasks talk to oss through the transport from transport.h kept on the heap, so requests, releases, and replies work just as
+// they do for worker processes. oss starts a task in a free slot with taskSpawn and kills one with taskKill. A task that decides to exit
+// marks its slot in a mask that oss collects with taskReap, the way it would reap an exited child.
+// Each slot's state says who may touch it. A thread only steps a running task, and marks the slot busy around the step, so taskKill can
+// wait out a step in progress and know the thread will leave the slot alone from then on.
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "clock.h"
+#include "transport.h"
+#include "matrix.h"
+#include "client.h"
+
+// States of a task's slot
+#define TASK_FREE 0 // No task, threads skip the slot
+#define TASK_RUNNING 1 // Task is stepped by its thread
+#define TASK_EXITED 2 // Task decided to exit and waits for oss to reap it
+#define TASK_KILLED 3 // oss is killing the task
+
+// Structure for one task
+typedef struct
+{
+	Client client; // What the task does
+	alignas(CACHE_LINE) std::atomic<uint32_t> state; // TASK_ state of the slot
+	std::atomic<uint32_t> busy; // Set while the slot's thread is stepping the task
+} Task;
+
+// Structure for the task pool
+typedef struct
+{
+	Task* tasks; // One per process table slot
+	int n; // Amount of slots
+	int nThreads; // Amount of threads stepping tasks
+	pthread_t* threads;
+	Transport* ring; // Transport tasks talk to oss through
+	std::atomic<uint64_t>* exited; // Bit per slot whose task has exited and not been reaped yet
+	std::atomic<uint32_t> stop; // Set once oss is done, the threads exit
+	bool started; // Threads are running
+} TaskPool;
+
+inline TaskPool taskPool = {NULL, 0, 0, NULL, NULL, NULL, {0}, false};
+
+// Function used by tasks to send a message to oss. The client is the first thing in its task, so the task's index is its slot
+inline void taskSend(Client* c, msgbuffer* msg)
+{
+	ringPush(taskPool.ring, (int)((Task*)c - taskPool.tasks), msg);
+}
+
+// Function to take every reply waiting for the task in slot, then step it until it waits again. A task that decides to exit is marked
+// for oss to reap, unless oss is killing it at the same time. Returns true if the task did anything
+inline bool taskStep(int slot)
+{
+	Task* task = &taskPool.tasks[slot];
+	Mailbox* mb = transportMailbox(taskPool.ring, slot);
+	msgbuffer reply;
+	bool progress = false;
+	while (mailboxTryTake(mb, &reply))
+	{
+		clientReply(&task->client, &reply);
+		progress = true;
+	}
+
+	if (clientStep(&task->client) == CLIENT_EXIT)
+	{
+		uint32_t running = TASK_RUNNING;
+		if (task->state.compare_exchange_strong(running, TASK_EXITED))
+		{
+			taskPool.exited[slot / 64].fetch_or(1ULL << (slot % 64), std::memory_order_release);
+			ringNotify(taskPool.ring);
+		}
+		progress = true;
+	}
+	return progress;
+}
+
+// Function run by each task thread, passing over its range of slots until oss stops the pool. A pass where no task did anything while
+// the clock stood still found nothing to do, so the thread yields before the next one
+inline void* taskThread(void* arg)
+{
+	int t = (int)(intptr_t)arg;
+	int first = (int)((int64_t)taskPool.n * t / taskPool.nThreads);
+	int last = (int)((int64_t)taskPool.n * (t + 1) / taskPool.nThreads);
+	SimClock* clock = taskPool.tasks[0].client.clock;
+	uint64_t lastNow = 0;
+
+	while (!taskPool.stop.load(std::memory_order_relaxed))
+	{
+		bool idle = true;
+		for (int slot = first; slot < last; slot++)
+		{
+			Task* task = &taskPool.tasks[slot];
+			if (task->state.load(std::memory_order_acquire) != TASK_RUNNING)
+				continue;
+			// Mark the slot busy before checking the state again, so either taskKill sees the step or the step sees the kill
+			task->busy.store(1, std::memory_order_seq_cst);
+			if (task->state.load(std::memory_order_seq_cst) == TASK_RUNNING && taskStep(slot))
+				idle = false;
+			task->busy.store(0, std::memory_order_release);
+		}
+
+		uint64_t now = clockNow(clock);
+		if (idle && now == lastNow)
+			sched_yield();
+		lastNow = now;
+	}
+	return NULL;
+}
+
+// Function to stop the threads and free the tasks. Tasks still running are dropped where they are
+inline void taskPoolStop()
+{
+	if (!taskPool.started)
+		return;
+	taskPool.stop.store(1, std::memory_order_relaxed);
+	for (int t = 0; t < taskPool.nThreads; t++)
+		pthread_join(taskPool.threads[t], NULL);
+	taskPool.started = false;
+
+	for (int i = 0; i < taskPool.n; i++)
+		clientFree(&taskPool.tasks[i].client);
+	delete[] taskPool.tasks;
+	delete[] taskPool.exited;
+	delete[] taskPool.threads;
+}
+
+// Function to set up a task for each of n slots with the settings in proto, then start nThreads threads to step them. The threads block
+// every signal so they are all handled on the oss main thread. Returns false if a thread could not be started
+inline bool taskPoolStart(int n, int nThreads, Transport* ring, const Client* proto)
+{
+	taskPool.n = n;
+	taskPool.nThreads = nThreads < n ? nThreads : n;
+	taskPool.ring = ring;
+	taskPool.tasks = new Task[n];
+	for (int i = 0; i < n; i++)
+	{
+		Task* task = &taskPool.tasks[i];
+		task->client = *proto;
+		task->client.send = taskSend;
+		clientAlloc(&task->client);
+		task->state.store(TASK_FREE);
+		task->busy.store(0);
+	}
+	taskPool.exited = new std::atomic<uint64_t>[maskWords(n)];
+	for (int w = 0; w < maskWords(n); w++)
+		taskPool.exited[w].store(0);
+	taskPool.stop.store(0);
+
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	taskPool.threads = new pthread_t[taskPool.nThreads];
+	int started = 0;
+	while (started < taskPool.nThreads && pthread_create(&taskPool.threads[started], NULL, taskThread, (void*)(intptr_t)started) == 0)
+		started++;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	// Stop the threads that did start if any failed, since their slots would never be stepped
+	taskPool.started = true;
+	if (started < taskPool.nThreads)
+	{
+		taskPool.nThreads = started;
+		taskPoolStop();
+		return false;
+	}
+	return true;
+}
+
+// Function to start a new task in a free slot as pid. The slot's thread skips it until it is marked running, so the client is set up
+// here without racing the thread
+inline void taskSpawn(int slot, pid_t pid)
+{
+	Task* task = &taskPool.tasks[slot];
+	task->client.pid = pid;
+	clientStart(&task->client);
+	task->state.store(TASK_RUNNING, std::memory_order_release);
+}
+
+// Function to kill the task in slot, whether or not it has exited on its own already. Waits out any step its thread is in the middle
+// of, so once this returns the thread leaves the slot alone until a new task is spawned in it
+inline void taskKill(int slot)
+{
+	Task* task = &taskPool.tasks[slot];
+	task->state.store(TASK_KILLED, std::memory_order_seq_cst);
+	while (task->busy.load(std::memory_order_seq_cst))
+		sched_yield();
+	task->state.store(TASK_FREE, std::memory_order_relaxed);
+}
+
+// Function to find if any task has exited since the last taskReap
+inline bool taskExitsPending()
+{
+	for (int w = 0; w < maskWords(taskPool.n); w++)
+		if (taskPool.exited[w].load(std::memory_order_relaxed) != 0)
+			return true;
+	return false;
+}
+
+// Function to collect the slots whose tasks have exited since the last call into slots, freeing each, and return the count. A slot oss
+// killed in the meantime is left out, since oss already took it back
+inline int taskReap(int slots[])
+{
+	int cnt = 0;
+	for (int w = 0; w < maskWords(taskPool.n); w++)
+	{
+		if (taskPool.exited[w].load(std::memory_order_relaxed) == 0)
+			continue;
+		uint64_t bits = taskPool.exited[w].exchange(0, std::memory_order_acquire);
+		while (bits != 0)
+		{
+			int slot = w * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			uint32_t exited = TASK_EXITED;
+			if (taskPool.tasks[slot].state.compare_exchange_strong(exited, TASK_FREE))
+				slots[cnt++] = slot;
+		}
+	}
+	return cnt;
+}
+
+#endif
@@ -0,0 +1,159 @@
+// Operating Systems Project 5
+// Description: Binary event trace written by oss and read by osstrace. The trace file is a header followed by fixed size records, one
+// per event, and is mapped into oss's memory so recording an event is just filling in the next record, with no formatting or system
+// call. The file is made larger and mapped again whenever it fills up, so no event is lost. When oss exits the header gets the final
+// count of records and the file is cut down to the records written.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#define TRACE_MAGIC 0x454341525453534FULL // "OSSTRACE" read as a little endian number
+#define TRACE_VERSION 2 // 2 widened slot and resource to 32 bits
+#define TRACE_INITIAL (1 << 16) // Records room is made for when the trace is opened, doubled each time it fills
+
+// Kinds of event
+#define TRACE_SPAWN 0 // Worker was forked into slot
+#define TRACE_REQUEST 1 // Worker requested count of resource
+#define TRACE_GRANT 2 // Request was granted as soon as it arrived
+#define TRACE_WAIT 3 // Request was queued, resource is the one it is short of
+#define TRACE_UNSAFE 4 // Request was queued because granting it would be unsafe
+#define TRACE_DENY 5 // Request was refused
+#define TRACE_WAKE 6 // Queued request was granted
+#define TRACE_RELEASE 7 // Worker released count of resource
+#define TRACE_CLAIM 8 // Worker declared a claim of count of resource
+#define TRACE_DEADLOCK 9 // Worker was found deadlocked
+#define TRACE_KILL 10 // Worker was killed by deadlock recovery
+#define TRACE_EXIT 11 // Worker exited on its own
+#define TRACE_KINDS 12
+
+// Structure for one event
+typedef struct
+{
+	uint64_t ns; // Simulated time of the event
+	int32_t pid; // Worker's pid
+	uint32_t seq; // Worker's number for the request or release, 0 if none
+	int32_t count; // Instances, 0 if none
+	int32_t slot; // Worker's process table slot
+	int32_t res; // Resource, -1 if none
+	uint8_t kind; // One of the TRACE_ kinds
+	uint8_t pad[3];
+} TraceRecord;
+
+static_assert(sizeof(TraceRecord) == 32, "Trace records must stay 32 bytes so they pack evenly into pages");
+
+// Structure for the start of a trace file
+typedef struct
+{
+	uint64_t magic; // TRACE_MAGIC
+	uint32_t version; // TRACE_VERSION
+	uint32_t recordSize; // sizeof(TraceRecord)
+	uint64_t count; // Records in the file
+	uint64_t pad[5];
+} TraceHeader;
+
+// Structure for a trace being written
+typedef struct
+{
+	int fd; // Trace file, -1 when not tracing
+	TraceHeader* header; // Mapped file
+	TraceRecord* records; // Records following the header
+	uint64_t count; // Records written
+	uint64_t cap; // Records the file has room for
+	pid_t owner; // Process writing the trace, so a forked child that exits does not close it
+} Trace;
+
+inline Trace trace = {-1, NULL, NULL, 0, 0, 0};
+
+// Function to get the bytes a trace file of cap records takes
+inline size_t traceBytes(uint64_t cap)
+{
+	return sizeof(TraceHeader) + cap * sizeof(TraceRecord);
+}
+
+// Function to give the trace file disk space for cap records and map it. Returns false if the file cannot be grown or mapped
+inline bool traceMap(uint64_t cap)
+{
+	if (posix_fallocate(trace.fd, 0, traceBytes(cap)) != 0)
+		return false;
+	void* map = trace.header == NULL
+		? mmap(NULL, traceBytes(cap), PROT_READ | PROT_WRITE, MAP_SHARED, trace.fd, 0)
+		: mremap(trace.header, traceBytes(trace.cap), traceBytes(cap), MREMAP_MAYMOVE);
+	if (map == MAP_FAILED)
+		return false;
+	// Fault in the new room now, so recording an event never stops on a page fault
+#ifdef MADV_POPULATE_WRITE
+	size_t old = trace.header == NULL ? 0 : traceBytes(trace.cap) & ~(size_t)4095;
+	madvise((char*)map + old, traceBytes(cap) - old, MADV_POPULATE_WRITE);
+#endif
+	trace.header = (TraceHeader*)map;
+	trace.records = (TraceRecord*)(trace.header + 1);
+	trace.cap = cap;
+	return true;
+}
+
+// Function to write out the final record count, then unmap the trace and cut the file to the records written. Registered with atexit
+// so a trace ended by the real time limit is still complete
+inline void traceClose()
+{
+	if (trace.fd < 0 || getpid() != trace.owner)
+		return;
+	trace.header->count = trace.count;
+	munmap(trace.header, traceBytes(trace.cap));
+	if (ftruncate(trace.fd, traceBytes(trace.count)) == -1)
+	{
+		// File keeps its unused room, which readers skip since they go by count
+	}
+	close(trace.fd);
+	trace.fd = -1;
+}
+
+// Function to start writing a trace to the file at path, replacing it. Returns false if it cannot be created or mapped
+inline bool traceOpen(const char* path)
+{
+	trace.fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (trace.fd < 0)
+		return false;
+	if (!traceMap(TRACE_INITIAL))
+	{
+		close(trace.fd);
+		trace.fd = -1;
+		return false;
+	}
+	trace.header->magic = TRACE_MAGIC;
+	trace.header->version = TRACE_VERSION;
+	trace.header->recordSize = sizeof(TraceRecord);
+	trace.header->count = 0;
+	trace.owner = getpid();
+	atexit(traceClose);
+	return true;
+}
+
+// Function to record an event if tracing. Doubles the file when it is full, and stops tracing if that fails
+inline void traceEvent(uint64_t ns, int kind, int slot, pid_t pid, int res = -1, int count = 0, uint32_t seq = 0)
+{
+	if (trace.fd < 0)
+		return;
+	if (trace.count == trace.cap && !traceMap(trace.cap * 2))
+	{
+		traceClose();
+		return;
+	}
+	TraceRecord* rec = &trace.records[trace.count++];
+	rec->ns = ns;
+	rec->pid = pid;
+	rec->seq = seq;
+	rec->count = count;
+	rec->slot = slot;
+	rec->res = res;
+	rec->kind = kind;
+}
+
+#endif
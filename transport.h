@@ -0,0 +1,316 @@
+// Operating Systems Project 5
+// Description: Message layout shared by oss and workers, along with the shared memory transport that can be used in place of the System V
+// message queue. The transport is a single segment holding a lock-free ring that any worker can push requests/releases into and only oss
+// pops from, plus one reply mailbox per process table slot that only oss posts to and only that slot's worker takes from. Neither side
+// makes a system call unless the other side is asleep on a futex. The segment is sized at startup to the process table: a fixed header,
+// then the ring cells, then the mailboxes. Workers run as tasks inside oss use the same layout on the heap instead of in a segment.
+// A worker can be killed after claiming a ring cell and before publishing it, which would stop oss at that cell for good. Each claim
+// records the slot that made it, so once oss has reaped a worker it drops any cell the worker claimed and never published.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <atomic>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "clock.h"
+#include "futex.h"
+
+#define RING_SIZE 256 // Smallest request ring capacity, grown to a power of 2 with room for every slot
+#define MAILBOX_SIZE 16 // Replies a mailbox can hold before oss must wait for the worker
+
+#define MSG_UNITS 4 // Most (resource, count) pairs one message can carry
+
+// Kinds of message a worker can send to oss
+#define MSG_REQUEST 0 // Request every pair in units
+#define MSG_RELEASE 1 // Release every pair in units
+#define MSG_SLEEP 2 // Reply once the clock reaches wakeAt, used in discrete event mode
+#define MSG_CLAIM 3 // Declare the most instances of each resource in units the worker will ever hold, used in avoidance mode
+#define MSG_DONE 4 // Lifetime is over, the worker waits in oss's pool to be started again instead of exiting
+#define MSG_WAKE 6 // Nothing to handle, only ends oss's event mode sleep so it sees a clock deadline registered while it slept
+// Kind of message oss sends a pooled worker to start a new lifetime
+#define MSG_START 5
+
+// Structure for an amount of one resource
+typedef struct
+{
+	int resId; // Which resource
+	int count; // How many instances
+} ResUnits;
+
+// Message buffer for communication between OSS and child processes
+typedef struct msgbuffer
+{
+	long mtype; // Message type used for message queue
+	pid_t pid;
+	int kind; // MSG_REQUEST, MSG_RELEASE, MSG_SLEEP, MSG_CLAIM, MSG_DONE, or MSG_START
+	uint32_t seq; // Worker's number for a request or release, sent back in the reply so replies can be matched as they arrive. For
+	              // MSG_START, the process table slot the new lifetime runs in
+	int nUnits; // Amount of pairs in units
+	ResUnits units[MSG_UNITS]; // Resources to request, release, or claim, and how many of each
+	bool partial; // Request may be granted a resource at a time as instances free up, instead of all at once
+	bool granted; // Grant resources to worker
+	uint64_t wakeAt; // Time worker wants to be woken at by MSG_SLEEP, or in discrete event mode the reply to a request or release held
+	                 // until, 0 for right away
+} msgbuffer;
+
+#define RING_DROPPED 0xFFFFFFFFu // Owner of a cell oss dropped because its producer died, skipped when popped
+
+// Structure for one entry in the request ring. The low half of state is seq, which tells whose turn it is: equal to the position when
+// free for a producer, position + 1 once a message has been published for oss. The high half is the owner, 1 + the slot of the producer
+// that claimed the cell and has not published it yet, otherwise 0
+typedef struct
+{
+	std::atomic<uint64_t> state;
+	msgbuffer msg;
+} RingCell;
+
+// Function to pack a ring cell's owner and seq into its state
+inline uint64_t ringState(uint32_t owner, uint32_t seq)
+{
+	return (uint64_t)owner << 32 | seq;
+}
+
+// Function to get the seq of a ring cell's state
+inline uint32_t ringSeq(uint64_t state)
+{
+	return (uint32_t)state;
+}
+
+// Function to get the owner of a ring cell's state
+inline uint32_t ringOwner(uint64_t state)
+{
+	return (uint32_t)(state >> 32);
+}
+
+// Structure for one slot's reply mailbox
+typedef struct
+{
+	alignas(CACHE_LINE) std::atomic<uint32_t> tail; // Replies posted by oss. Also the futex word the worker sleeps on
+	std::atomic<uint32_t> waiting; // Set while the worker is asleep on tail
+	alignas(CACHE_LINE) std::atomic<uint32_t> head; // Replies taken by the worker
+	msgbuffer replies[MAILBOX_SIZE];
+} Mailbox;
+
+// Structure for the header of the transport segment
+typedef struct
+{
+	uint32_t ringSize; // Ring capacity, a power of 2. Set once by oss
+	int nMailboxes; // One mailbox per process table slot. Set once by oss
+	alignas(CACHE_LINE) std::atomic<uint32_t> tail; // Next ring position to be claimed by a producer
+	alignas(CACHE_LINE) std::atomic<uint32_t> waiting; // Set while oss is asleep. Also the futex word oss sleeps on
+	uint32_t head; // Next ring position oss will pop, only touched by oss
+} Transport;
+
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of 2");
+
+// Function to get the ring capacity for msgs messages, so every worker can have each message it may have in flight in the ring without
+// waiting for room
+inline uint32_t ringSizeFor(size_t msgs)
+{
+	uint32_t size = RING_SIZE;
+	while (size < msgs)
+		size *= 2;
+	return size;
+}
+
+// Function to get the size of the ring cells, rounded up so the mailboxes after them start on a cache line
+inline size_t ringCellsBytes(uint32_t ringSize)
+{
+	return (ringSize * sizeof(RingCell) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+// Function to get the size of a transport segment for n slots, each with up to perSlot messages in flight
+inline size_t transportSize(int n, int perSlot)
+{
+	return sizeof(Transport) + ringCellsBytes(ringSizeFor((size_t)n * perSlot)) + n * sizeof(Mailbox);
+}
+
+// Function to get the ring cell for a position
+inline RingCell* ringCell(Transport* t, uint32_t pos)
+{
+	return (RingCell*)(t + 1) + (pos & (t->ringSize - 1));
+}
+
+// Function to get the reply mailbox for a slot
+inline Mailbox* transportMailbox(Transport* t, int slot)
+{
+	return (Mailbox*)((char*)(t + 1) + ringCellsBytes(t->ringSize)) + slot;
+}
+
+// Function to empty a mailbox before a new worker takes over its slot
+inline void mailboxReset(Mailbox* mb)
+{
+	mb->tail.store(0);
+	mb->waiting.store(0);
+	mb->head.store(0);
+}
+
+// Function to initialize a newly created transport segment for n slots, each with up to perSlot messages in flight
+inline void transportInit(Transport* t, int n, int perSlot)
+{
+	t->ringSize = ringSizeFor((size_t)n * perSlot);
+	t->nMailboxes = n;
+	t->tail.store(0);
+	t->waiting.store(0);
+	t->head = 0;
+	for (uint32_t i = 0; i < t->ringSize; i++)
+		ringCell(t, i)->state.store(ringState(0, i));
+	for (int i = 0; i < n; i++)
+		mailboxReset(transportMailbox(t, i));
+}
+
+// Function to wake oss if it is asleep, once something it should see has been published. Only makes the wake system call if oss said
+// it is going to sleep
+inline void ringNotify(Transport* t)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (t->waiting.load(std::memory_order_relaxed))
+	{
+		t->waiting.store(0, std::memory_order_relaxed);
+		futexWake(&t->waiting, 1);
+	}
+}
+
+// Function for the worker in slot to push a message to oss. Claims a cell by marking it as the slot's, then moves the tail past it,
+// so a worker that dies in between leaves a claim oss can find. Waits for room if the ring is full and wakes oss if it is asleep
+inline void ringPush(Transport* t, int slot, const msgbuffer* msg)
+{
+	uint32_t pos = t->tail.load(std::memory_order_relaxed);
+	RingCell* cell;
+	while (true)
+	{
+		cell = ringCell(t, pos);
+		uint64_t state = cell->state.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(ringSeq(state) - pos);
+		if (diff == 0 && ringOwner(state) == 0)
+		{
+			// Cell is free at this position, try to claim it, then move the tail past it unless another producer already has
+			if (cell->state.compare_exchange_weak(state, ringState(slot + 1, pos), std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				uint32_t expected = pos;
+				t->tail.compare_exchange_strong(expected, pos + 1, std::memory_order_relaxed);
+				break;
+			}
+		}
+		else if (diff == 0)
+		{
+			// Another producer claimed this position but has not moved the tail yet, move it for them
+			uint32_t expected = pos;
+			t->tail.compare_exchange_strong(expected, pos + 1, std::memory_order_relaxed);
+			pos = t->tail.load(std::memory_order_relaxed);
+		}
+		else if (diff < 0)
+		{
+			// Ring is full, let oss catch up
+			sched_yield();
+			pos = t->tail.load(std::memory_order_relaxed);
+		}
+		else // Another producer claimed this position first
+			pos = t->tail.load(std::memory_order_relaxed);
+	}
+
+	// Fill the cell and publish it to oss
+	cell->msg = *msg;
+	cell->state.store(ringState(0, pos + 1), std::memory_order_release);
+	ringNotify(t);
+}
+
+// Function for oss to pop the next message into out, skipping cells it dropped. Returns false if the ring is empty
+inline bool ringPop(Transport* t, msgbuffer* out)
+{
+	while (true)
+	{
+		RingCell* cell = ringCell(t, t->head);
+		uint64_t state = cell->state.load(std::memory_order_acquire);
+		if (ringSeq(state) != t->head + 1)
+			return false;
+		bool dropped = ringOwner(state) == RING_DROPPED;
+		if (!dropped)
+			*out = cell->msg;
+		// Hand the cell back to producers for the next lap of the ring
+		cell->state.store(ringState(0, t->head + t->ringSize), std::memory_order_release);
+		t->head++;
+		if (!dropped)
+			return true;
+	}
+}
+
+// Function for oss to drop any cell claimed and never published by the worker in slot, once that worker is known to be dead. The
+// claim may not have moved the tail yet, so the cell at the tail is checked too
+inline void ringDropDead(Transport* t, int slot)
+{
+	uint32_t end = t->tail.load(std::memory_order_acquire);
+	uint64_t state = ringCell(t, end)->state.load(std::memory_order_acquire);
+	if (ringSeq(state) == end && ringOwner(state) == (uint32_t)slot + 1)
+	{
+		uint32_t expected = end;
+		t->tail.compare_exchange_strong(expected, end + 1, std::memory_order_relaxed);
+		end++;
+	}
+	for (uint32_t pos = t->head; pos != end; pos++)
+	{
+		RingCell* cell = ringCell(t, pos);
+		state = cell->state.load(std::memory_order_acquire);
+		if (ringSeq(state) == pos && ringOwner(state) == (uint32_t)slot + 1)
+			cell->state.store(ringState(RING_DROPPED, pos + 1), std::memory_order_release);
+	}
+}
+
+// Function for oss to sleep until a message may be waiting, timeout passes, or oss is woken by a signal handler
+inline void ringWait(Transport* t, const struct timespec* timeout)
+{
+	t->waiting.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// Recheck after announcing sleep so a message published in between is not missed
+	if (ringSeq(ringCell(t, t->head)->state.load(std::memory_order_acquire)) == t->head + 1)
+	{
+		t->waiting.store(0, std::memory_order_relaxed);
+		return;
+	}
+	futexWait(&t->waiting, 1, timeout);
+	t->waiting.store(0, std::memory_order_relaxed);
+}
+
+// Function for oss to post a reply into a slot's mailbox, waking its worker if it is asleep
+inline void mailboxPost(Mailbox* mb, const msgbuffer* msg)
+{
+	uint32_t tail = mb->tail.load(std::memory_order_relaxed);
+	while (tail - mb->head.load(std::memory_order_acquire) >= MAILBOX_SIZE)
+		sched_yield();
+	mb->replies[tail % MAILBOX_SIZE] = *msg;
+	mb->tail.store(tail + 1, std::memory_order_seq_cst);
+	if (mb->waiting.load(std::memory_order_seq_cst))
+		futexWake(&mb->tail, 1);
+}
+
+// Function for a worker to take the next reply from its mailbox without sleeping. Returns false if none has been posted
+inline bool mailboxTryTake(Mailbox* mb, msgbuffer* out)
+{
+	uint32_t head = mb->head.load(std::memory_order_relaxed);
+	if (mb->tail.load(std::memory_order_acquire) == head)
+		return false;
+	*out = mb->replies[head % MAILBOX_SIZE];
+	mb->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+// Function for a worker to take the next reply from its mailbox, sleeping until one is posted
+inline void mailboxTake(Mailbox* mb, msgbuffer* out)
+{
+	uint32_t head = mb->head.load(std::memory_order_relaxed);
+	while (mb->tail.load(std::memory_order_acquire) == head)
+	{
+		mb->waiting.store(1, std::memory_order_seq_cst);
+		if (mb->tail.load(std::memory_order_seq_cst) == head)
+			futexWait(&mb->tail, head, NULL);
+		mb->waiting.store(0, std::memory_order_relaxed);
+	}
+	*out = mb->replies[head % MAILBOX_SIZE];
+	mb->head.store(head + 1, std::memory_order_release);
+}
+
+#endif
@@ -3,10 +3,14 @@
 // Date: 04/29/2025
 // Description: Worker process launched by oss. Uses the clock in shared memory and loops continuously. Within the loop, it will randomly generate a time to
 // act within BOUND_NS (1000). Once it acts, it will randomly generate a probability to determine if it should request a new resource or release resources
-// being held. It sends a message to oss informing if it is a request or release, along with the resource id. It will then wait for a response from oss and will
+// being held. It sends a message to oss informing if it is a request or release, along with each resource id and how many instances. It will then wait for a response from oss and will
 // update its values if the message was granted. Each time it sends/receives a message it will increment the system clock. It will also continuously check every
 // 250000000 ns if it has run for 1 sec. If it has run for that time, it will randomly generate a probability to determine if it should terminate or continue looping.
-// Once it terminates, it will release all held resources, detaches from shared memory, and exit.
+// Once it terminates, it detaches from shared memory and exits, and oss takes back every resource it held when it sees the exit.
+// What the worker does is kept in client.h, shared with the tasks oss can run in place of worker processes. This file attaches to
+// oss and waits for replies and the clock however it was told to.
+// A worker in oss's pool does not exit when its lifetime ends. It tells oss, which takes back what it held, then waits for oss to start
+// a new lifetime in a slot, saving a new process for each.
 
 #include <string.h>
 #include <stdio.h>
@@ -19,35 +23,34 @@
 #include <cstdio>
 #include <cstdlib>
 
-#define PERMS 0644
-#define MAX_RES 5
-#define INST_PER_RES 10
-#define BOUND_NS 1000
-#define TERM_CHECK_NS 250000000
-#define LIFE_NS 2000000000
-#define TERM_PROB 40
+#include "clock.h"
+#include "transport.h"
+#include "client.h"
 
-// Message buffer structure
-typedef struct msgbuffer
-{
-	long mtype; 
-	pid_t pid; 
-	int resId;
-	bool isRelease;
-	bool granted;
-} msgbuffer;
+#define PERMS 0644
+#define DEF_RES 5 // Resource types if oss does not pass -m
+#define DEF_INST 10 // Instances of each resource if oss does not pass -u
 
 // Shared memory pointers for system clock
-int *shm_ptr;
+SimClock *shm_ptr;
 int shm_id;
 
+// Message queue ID, used unless oss started worker with the shared memory transport
+int msqid = 0;
+
+// This worker's process table slot, -1 if oss did not pass one
+int slot = -1;
+
+// Shared memory transport, NULL when using the message queue
+Transport* ring = NULL;
+
 // Function to attach to shared memory
 void shareMem()
 {
 	// Generate key
 	const int sh_key = ftok("main.c", 0);
 	// Access shared memory
-	shm_id = shmget(sh_key, sizeof(int) * 2, 0666);
+	shm_id = shmget(sh_key, sizeof(SimClock), 0666);
 
 	// Determine if shared memory access not successful
 	if (shm_id == -1)
@@ -58,9 +61,9 @@ void shareMem()
 	}
 
 	// Attach shared memory
-	shm_ptr = (int *)shmat(shm_id, 0, 0);
+	shm_ptr = (SimClock *)shmat(shm_id, 0, 0);
 	//Determine if insuccessful
-	if (shm_ptr == (int *)-1)
+	if (shm_ptr == (SimClock *)-1)
 	{
 		// If true, print error message and exit
 		fprintf(stderr, "Child: Shared memory attach failed.\n");
@@ -68,27 +71,173 @@ void shareMem()
 	}
 }
 
-// Function to increment time by 1000 ns 
-void addTime()
+// Function to attach to the shared memory transport created by oss
+void attachRing()
+{
+	const int ring_key = ftok("msgq.txt", 2);
+	int ring_id = shmget(ring_key, sizeof(Transport), 0666);
+	if (ring_id == -1)
+	{
+		fprintf(stderr, "Child: Transport shared memory get failed.\n");
+		exit(1);
+	}
+
+	ring = (Transport *)shmat(ring_id, 0, 0);
+	if (ring == (Transport *)-1)
+	{
+		fprintf(stderr, "Child: Transport shared memory attach failed.\n");
+		exit(1);
+	}
+}
+
+// Function to send a message to oss through whichever transport is in use
+void sendMsg(Client* /*c*/, msgbuffer* buf)
+{
+	if (ring != NULL)
+	{
+		ringPush(ring, slot, buf);
+		return;
+	}
+	if (msgsnd(msqid, buf, sizeof(msgbuffer) - sizeof(long), 0) == -1)
+	{
+		perror("msgsnd");
+		exit(1);
+	}
+}
+
+// Function to wait for oss to reply through whichever transport is in use
+void recvMsg(msgbuffer* rcvbuf, const char* what)
 {
-	shm_ptr[1] += 1000;
-	// Ensure ns did not overflow 
-	if (shm_ptr[1] > 1000000000) 
+	if (ring != NULL)
+	{
+		mailboxTake(transportMailbox(ring, slot), rcvbuf);
+		return;
+	}
+	if (msgrcv(msqid, rcvbuf, sizeof(msgbuffer) - sizeof(long), getpid(), 0) == -1)
 	{
-		shm_ptr[1] -= 1000000000;
-		shm_ptr[0]++;
+		perror(what);
+		exit(1);
 	}
 }
 
+// Function for a pooled worker to wait until oss starts a new lifetime, and take the slot it runs in. The start always comes on the
+// message queue, since an idle worker has no slot's mailbox to read
+void waitStart()
+{
+	msgbuffer start;
+	start.kind = -1;
+	do
+	{
+		if (msgrcv(msqid, &start, sizeof(msgbuffer) - sizeof(long), getpid(), 0) == -1 && errno != EINTR)
+		{
+			perror("msgrcv start");
+			exit(1);
+		}
+	} while (start.kind != MSG_START);
+	slot = start.seq;
+}
+
+// Function to take a reply from oss if one has already arrived, through whichever transport is in use. Returns false if none has
+bool tryRecvMsg(msgbuffer* rcvbuf, const char* what)
+{
+	if (ring != NULL)
+		return mailboxTryTake(transportMailbox(ring, slot), rcvbuf);
+	if (msgrcv(msqid, rcvbuf, sizeof(msgbuffer) - sizeof(long), getpid(), IPC_NOWAIT) == -1)
+	{
+		if (errno == ENOMSG || errno == EINTR)
+			return false;
+		perror(what);
+		exit(1);
+	}
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
 	shareMem();
+
+	// oss passes this worker's process table slot, along with "-r" when messages go through the shared memory transport
+	// and "-w" when the worker should sleep on the clock instead of spinning, or "-d" in discrete event mode. "-b" means oss is
+	// avoiding deadlock and the worker must declare its claims before requesting. "-m" and "-u" give the amount of resource types
+	// and a comma separated list of how many instances of each there are. "-x" gives the most instances to request at once, and "-a"
+	// the most requests and releases to keep in flight. "-l" keeps the worker in oss's pool, and without a slot it starts out idle
+	Client client;
+	client.clock = shm_ptr;
+	client.pid = getpid();
+	client.nRes = DEF_RES;
+	client.burst = 1;
+	client.maxOps = 1;
+	client.des = false;
+	client.avoid = false;
+	client.send = sendMsg;
+	bool clockWait = false;
+	bool pooled = false;
+	const char* instArg = NULL;
+	char opt;
+	while ((opt = getopt(argc, argv, "s:rwdbm:u:x:a:l")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				slot = atoi(optarg);
+				break;
+			case 'r':
+				attachRing();
+				break;
+			case 'w':
+				clockWait = true;
+				break;
+			case 'd':
+				client.des = true;
+				break;
+			case 'b':
+				client.avoid = true;
+				break;
+			case 'm':
+				client.nRes = atoi(optarg);
+				break;
+			case 'u':
+				instArg = optarg;
+				break;
+			case 'x':
+				client.burst = atoi(optarg);
+				break;
+			case 'a':
+				client.maxOps = atoi(optarg);
+				break;
+			case 'l':
+				pooled = true;
+				break;
+		}
+	}
+	if ((ring != NULL || clockWait) && slot < 0 && !pooled)
+	{
+		fprintf(stderr, "Child: slot required for -r and -w.\n");
+		exit(1);
+	}
+	if (client.nRes < 1 || client.burst < 1 || client.maxOps < 1)
+	{
+		fprintf(stderr, "Child: at least 1 resource type, 1 instance per request, and 1 operation in flight required.\n");
+		exit(1);
+	}
+
+	// Read instances of each resource, the last one listed repeats for any types not listed
+	int* total = new int[client.nRes];
+	int last = DEF_INST;
+	for (int i = 0; i < client.nRes; i++)
+	{
+		if (instArg != NULL && *instArg != '\0')
+		{
+			last = strtol(instArg, (char**)&instArg, 10);
+			if (*instArg == ',')
+				instArg++;
+		}
+		total[i] = last;
+	}
+	client.total = total;
 	
-	// Info needed for message sending/receiving
-	msgbuffer buf;
+	// Info needed for message receiving
 	msgbuffer rcvbuf;
-	buf.mtype = 1;
-	int msqid = 0;
 	key_t key;
 
 	// Get key for message queue
@@ -105,170 +254,67 @@ int main(int argc, char* argv[])
 		exit(1);
 	}
 
-	// Represents how many of each resource worker holds
-	int held[MAX_RES] = {0};
+	// A pooled worker launched without a slot waits to be started
+	clientAlloc(&client);
+	if (pooled && slot < 0)
+		waitStart();
 
-	// Represents time process started in ns
-	long long startTimeNs = (long long)shm_ptr[0] * 1000000000 + shm_ptr[1];
-	long long lastTermChk = startTimeNs;
-
-	// Randomly generate a number within bound ns to determine when worker will act 
-	srand(getpid());
-	long long nAct = startTimeNs + (rand() % BOUND_NS);
-
-	while(true)
+	while (true)
 	{
-		// Calculate current system time in ns
-		long long currTimeNs = (long long)shm_ptr[0] * 1000000000 + shm_ptr[1];
+		// Start out holding and asking for nothing
+		clientStart(&client);
 
-		// Determine if worker should terminate every time it reaches term check (25000000 ns)
-		if (currTimeNs - lastTermChk >= TERM_CHECK_NS)
+		// Move the worker on until it decides to exit, waiting in between for whatever it needs next
+		int wait;
+		while ((wait = clientStep(&client)) != CLIENT_EXIT)
 		{
-			lastTermChk = currTimeNs;
-			// Once lifetime (1 sec)  is reached, worker will determine if it should terminate
-			if (currTimeNs - startTimeNs >= LIFE_NS)
+			if (wait == CLIENT_REPLY)
 			{
-				// Randomly generate number up to 100 to determine if worker will terminate
-				int die = rand() % 100;
-				// If randomly generated number is less than term probability (40), it will terminate
-				if (die < TERM_PROB)
-				{
-					// Release all resources currently held 
-					for (int i = 0; i < MAX_RES; i++)
-					{
-						while (held[i] > 0)
-						{
-							held[i]--;
-							buf.mtype = 1;
-							buf.resId = i;
-							buf.isRelease = true;
-
-							// Send message to OSS informing of release
-							if (msgsnd(msqid, &buf, sizeof(buf) - sizeof(long), 0) == -1)
-							{
-								perror("msgsnd release");
-								exit(1);
-							}
-							// Increment time for message sending
-							addTime();
-							
-							// Wait for OSS to acknowledge realease
-							if (msgrcv(msqid, &rcvbuf, sizeof(rcvbuf) - sizeof(long), getpid(), 0) == -1)
-							{
-								perror("msgrcv release ack");
-								exit(1);
-							}
-							// Increment time for message receivingg
-							addTime();
-
-						
-						}
-					}
-
-					// Detach from shared memory and exit
-					if (shmdt(shm_ptr) == -1)
-
-					{
-						perror("shmdt failed");
-						exit(1);
-					}
-					exit(0);
-				}
+				// Wait for OSS to send a message back
+				recvMsg(&rcvbuf, "msgrcv reply");
+				clientReply(&client, &rcvbuf);
 			}
-		}
-
-		// Determine if current time has reached time for worker to act
-		if (currTimeNs >= nAct)
-		{
-			// Randomly generate number up to 100 to determine if worker will request or release
-			int outcome = rand() % 100;
-			bool release;
-			// If outcome is greater than 5, worker will request. Otherwise worker will release
-			if (outcome > 5)
-				release = false;
-			else
-				release = true;
-
-
-			int r;
-			if (release) // Worker is releasing
+			// Sleep until the next time worker has something to do, or spin on the clock by stepping again
+			else if (clockWait)
 			{
-				// Randomly choose a resource to release
-				int tries = 0;
-				while (tries < MAX_RES)
+				// Wake oss if it is asleep and may not know of this deadline
+				if (clockRegister(shm_ptr, slot, client.wakeAt))
 				{
-					r = rand() % MAX_RES;
-					if (held[r] > 0)
-						break;
-					tries++;
+					msgbuffer wake;
+					wake.mtype = 1;
+					wake.pid = client.pid;
+					wake.kind = MSG_WAKE;
+					wake.seq = 0;
+					wake.nUnits = 0;
+					sendMsg(&client, &wake);
 				}
-				// Once max resource amount is reached, randomly generate time for next act and continue
-				if (tries == MAX_RES)
-				{
-					nAct = currTimeNs + (rand() % BOUND_NS);
-					continue;
-				}
-			}
-			else // Worker is requestin
-			{
-				// Randomly choose a resource to request
-				int tries = 0;
-				while (tries < MAX_RES)
-				{
-					r = rand() % MAX_RES;
-					if (held[r] < INST_PER_RES)
-						break;
-					tries++;
-				}
-				// Once max resource amount is reached, randomly generate time for next act and continue
-				if (tries == MAX_RES)
-				{
-					nAct = currTimeNs + (rand() % BOUND_NS);
-					continue;
-				}
-			}
-		
-
-			// Prepare info to send message to OSS, informing if it is a release or request and what resource is selected
-			buf.mtype = 1;
-			buf.pid = getpid();
-			buf.resId = r;
-			buf.isRelease = release;
-			buf.granted = false; 
-			// Send request/release message to OSS
-			if (msgsnd(msqid, &buf, sizeof(buf) - sizeof(long), 0) == -1)
-			{
-				perror("msgsnd request");
-				exit(1);
-			}
-
-			// Increment time for message sending
-			addTime();
-		
-			// Wait until OSS sends a message back
-			if (msgrcv(msqid, &rcvbuf, sizeof(rcvbuf) - sizeof(long), getpid(), 0) == -1)
-			{
-				perror("msgrcv grant");
-				exit(1);
-			}
-
-			// Increment time for message receiving
-			addTime();
-
-			if (rcvbuf.granted) // If new resource was received
-			{
-				if (release)
-					held[r]--;
-				else
-					// Increment held at resoure's location 
-					held[r]++;
+				clockWaitUntil(shm_ptr, slot, client.wakeAt);
 			}
 
-			// Randomly generate time for next act
-			nAct = currTimeNs + (rand() % BOUND_NS);
+			// Apply any replies to requests and releases in flight that came in meanwhile
+			while (client.awaiting < 0 && client.nInFlight > 0 && tryRecvMsg(&rcvbuf, "msgrcv reply"))
+				clientReply(&client, &rcvbuf);
 		}
-	}
+		if (!pooled)
+			break;
 
+		// Tell oss the lifetime is over so it takes back what was held, the same as when a worker exits, then wait to be started again
+		msgbuffer done;
+		done.mtype = 1;
+		done.pid = client.pid;
+		done.kind = MSG_DONE;
+		done.seq = 0;
+		done.nUnits = 0;
+		sendMsg(&client, &done);
+		waitStart();
+	}
 
+	// Detach from shared memory and exit. Held resources are not released one message at a time, oss takes them all back in one
+	// pass when it reaps this worker
+	if (shmdt(shm_ptr) == -1)
+	{
+		perror("shmdt failed");
+		exit(1);
+	}
 	return 0;
 }